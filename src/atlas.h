@@ -1,13 +1,23 @@
 #pragma once
 #include "header.h"
+#include "blockStorage.h"
 #include <unordered_map>
 #include <array>
-#include <set>
 
 
 
 // block atlas for types of blocks
 // used to fetch the correct texture for a block id
+// also owns the per block render properties the mesher uses for face culling
+
+
+// render properties of one block type, indexed directly by block id
+struct BlockProperties {
+    bool opaque = false;        // hides any face behind it
+    bool transparent = false;   // drawn in the transparent pass, faces behind it stay visible
+    bool cullSameType = false;  // faces between two blocks of this type are hidden, e.g. glass panes
+    uint8_t emission = 0;       // block light level given off, 0 - 15
+};
 
 class Atlas {
 private:
@@ -27,14 +37,12 @@ private:
         {5, {18, 18, 19, 19, 18, 18}},    // log
         {6, {20, 20, 20, 20, 20, 20}},    // leaves
         {7, {17, 17, 17, 17, 17, 17}},    // glass
+        {8, {224, 224, 224, 224, 224, 224}},    // lamp
     };
 
-    // convert index to uv coordinates
-    std::vector<float> getUVCoordinates(int index){
-        return { (index % TEXTURE_WIDTH) * UV_WIDTH, (index / TEXTURE_HEIGHT) * UV_HEIGHT};
-    }
-
-    std::set<int> transparentBlocks = {6, 7};
+    // dense tables over every block id, built once in the constructor
+    BlockProperties properties[256];
+    uint8_t textureIndex[256][6] = {};    // atlas tile per block face, 0 for unknown blocks
 
 public:
     float UV_WIDTH = 1.0f / (float)TEXTURE_WIDTH;
@@ -49,21 +57,62 @@ public:
         SAND = 4,
         Log = 5,
         Leaves = 6,
-        Glass = 7
+        Glass = 7,
+        Lamp = 8
     };
 
-    Atlas(){}
-
-    std::vector<float> getBlockCoordinates(int blockType, int face){
-        if(blockMap.find(blockType) == blockMap.end()){
-            std::cerr << "Block type not found" << std::endl;
-            return {0.0f, 0.0f};
+    Atlas(){
+        // every textured block is opaque unless listed below
+        for(auto & block : blockMap){
+            properties[block.first].opaque = true;
+            for(int face = 0; face < 6; face++) textureIndex[block.first][face] = block.second[face];
         }
-        return getUVCoordinates(blockMap[blockType][face]);
+
+        // inner leaf faces stay visible unless the snapshot asks for leaf culling, see cullsSameType
+        properties[Leaves].opaque = false;
+        properties[Leaves].transparent = true;
+
+        properties[Glass].opaque = false;
+        properties[Glass].transparent = true;
+        properties[Glass].cullSameType = true;
+
+        properties[Lamp].emission = 15;
+    }
+
+    // index of the atlas tile for a block face, uv offset is computed in the shader
+    // called for every emitted quad, so a plain table load
+    int getTextureIndex(BlockID blockType, int face) const {
+        return textureIndex[blockType][face];
+    }
+
+    const BlockProperties & getProperties(BlockID blockType) const {
+        return properties[blockType];
+    }
+
+    bool isTransparent(BlockID blockType) const {
+        return properties[blockType].transparent;
+    }
+
+    // blocks light and view completely, hides faces behind it
+    bool isOpaque(BlockID blockType) const {
+        return properties[blockType].opaque;
+    }
+
+    // block light level the block gives off, 0 for most blocks
+    int getEmission(BlockID blockType) const {
+        return properties[blockType].emission;
+    }
+
+    // faces between two blocks of this type are hidden
+    // leaf culling is an overlay setting carried by each ChunkSnapshot, the tables never change after construction
+    bool cullsSameType(BlockID blockType, bool cullLeaves) const {
+        return properties[blockType].cullSameType || (cullLeaves && blockType == Leaves);
     }
 
-    bool isTransparent(int blockType){
-        return transparentBlocks.find(blockType) != transparentBlocks.end();
+    // is the face of a block visible with neighbour on its other side, one table load
+    // air and transparent neighbours show it, unless both blocks are the same type and that type culls itself
+    bool isFaceVisible(BlockID blockType, BlockID neighbour, bool cullLeaves) const {
+        return !properties[neighbour].opaque && !(neighbour == blockType && cullsSameType(neighbour, cullLeaves));
     }
 
 };
\ No newline at end of file
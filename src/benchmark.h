@@ -0,0 +1,519 @@
+#pragma once
+#include "header.h"
+#include "atlas.h"
+#include "chunk.h"
+#include "chunkMap.h"
+#include "chunkManager.h"
+#include "lightEngine.h"
+#include "noise.h"
+#include "terrainGenerator.h"
+#include <random>
+#include <array>
+
+/*
+Benchmark
+micro benchmarks for hot paths, run with ./run --bench (make bench)
+no window or gl context needed, results are printed to stdout
+*/
+
+class Benchmark {
+private:
+    Atlas atlas;
+    TerrainGenerator terrainGenerator = TerrainGenerator(&atlas);
+
+    // time fn, returns nanoseconds per op
+    template <typename F>
+    double timeNs(long ops, F fn){
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / ops;
+    }
+
+    void printResult(const char * name, const char * baseline, double baselineNs, const char * candidate, double candidateNs){
+        printf("%-26s %s: %7.2f ns   %s: %7.2f ns   (%.2fx)\n", name, baseline, baselineNs, candidate, candidateNs, baselineNs / candidateNs);
+    }
+
+
+    // previous chunk map: int key, count() then operator[]
+    static int oldChunkIndex(glm::vec3 position){
+        return (position.x * 16 * 16) + (position.y * 16) + position.z;
+    }
+
+    static Chunk * oldGetChunk(std::unordered_map<int, Chunk*> & map, glm::vec3 position){
+        if(map.count(oldChunkIndex(position)) == 0){
+            return nullptr;
+        }
+        return map[oldChunkIndex(position)];
+    }
+
+    // same steps as ChunkManager::getBlock, map lookup passed in
+    template <typename Lookup>
+    static int getBlock(glm::vec3 position, Lookup lookup){
+        glm::vec3 chunkPosition = glm::vec3(floor(position.x / 16), floor(position.y / 16), floor(position.z / 16));
+        glm::vec3 blockPosition = glm::vec3(position.x - chunkPosition.x * 16, position.y - chunkPosition.y * 16, position.z - chunkPosition.z * 16);
+        Chunk * chunk = lookup(chunkPosition);
+        if(chunk == nullptr) return 0;
+        return chunk->getBlock(blockPosition.x, blockPosition.y, blockPosition.z);
+    }
+
+    // getChunk for the 6 neighbours of every chunk, and getBlock at random positions
+    // area is small enough that the old int key does not collide
+    void chunkLookup(){
+        const int radius = 8;
+        const int height = 8;
+        const int rounds = 200;
+        const int blockSamples = 1000000;
+
+        std::vector<glm::vec3> positions;
+        std::vector<Chunk*> chunks;
+        std::unordered_map<int, Chunk*> oldMap;
+        ChunkMap newMap;
+
+        for(int x = -radius; x < radius; x++){
+            for(int y = 0; y < height; y++){
+                for(int z = -radius; z < radius; z++){
+                    glm::vec3 position = glm::vec3(x, y, z);
+                    Chunk * chunk = new Chunk(terrainGenerator.generateChunk(position));
+                    positions.push_back(position);
+                    chunks.push_back(chunk);
+                    oldMap[oldChunkIndex(position)] = chunk;
+                    newMap.insert(chunkKey(x, y, z), chunk);
+                }
+            }
+        }
+
+        long lookups = (long) positions.size() * 6 * rounds;
+        size_t found = 0;
+
+        double oldNs = timeNs(lookups, [&]{
+            for(int r = 0; r < rounds; r++){
+                for(glm::vec3 & p : positions){
+                    for(int face = 0; face < 6; face++){
+                        found += oldGetChunk(oldMap, p + glm::vec3(faceDirection[face][0], faceDirection[face][1], faceDirection[face][2])) != nullptr;
+                    }
+                }
+            }
+        });
+
+        double newNs = timeNs(lookups, [&]{
+            for(int r = 0; r < rounds; r++){
+                for(glm::vec3 & p : positions){
+                    for(int face = 0; face < 6; face++){
+                        glm::vec3 n = p + glm::vec3(faceDirection[face][0], faceDirection[face][1], faceDirection[face][2]);
+                        found += newMap.find(chunkKey((int) n.x, (int) n.y, (int) n.z)) != nullptr;
+                    }
+                }
+            }
+        });
+        printResult("getChunk (neighbours)", "unordered_map", oldNs, "ChunkMap", newNs);
+
+
+        // random block positions inside the generated area
+        std::mt19937 random(1337);
+        std::uniform_real_distribution<float> horizontal(-radius * 16, radius * 16);
+        std::uniform_real_distribution<float> vertical(0, height * 16);
+        std::vector<glm::vec3> samples;
+        for(int i = 0; i < blockSamples; i++){
+            samples.push_back(glm::vec3(std::floor(horizontal(random)), std::floor(vertical(random)), std::floor(horizontal(random))));
+        }
+
+        long blockSum = 0;
+        oldNs = timeNs(blockSamples, [&]{
+            for(glm::vec3 & p : samples){
+                blockSum += getBlock(p, [&](glm::vec3 c){ return oldGetChunk(oldMap, c); });
+            }
+        });
+
+        newNs = timeNs(blockSamples, [&]{
+            for(glm::vec3 & p : samples){
+                blockSum += getBlock(p, [&](glm::vec3 c){ return newMap.find(chunkKey((int) c.x, (int) c.y, (int) c.z)); });
+            }
+        });
+        printResult("getBlock (random)", "unordered_map", oldNs, "ChunkMap", newNs);
+
+        // keep results live
+        printf("  (%zu chunks, checksum %zu %ld)\n", chunks.size(), found, blockSum);
+
+        for(Chunk * chunk : chunks) delete chunk;
+    }
+
+    // previous atlas lookup: find then operator[], uv returned in a new vector for every face
+    static std::vector<float> oldBlockCoordinates(std::unordered_map<int, std::array<int, 6>> & blockMap, int blockType, int face){
+        if(blockMap.find(blockType) == blockMap.end()) return {0.0f, 0.0f};
+        int index = blockMap[blockType][face];
+        return {(index % 16) / 16.0f, (index / 16) / 16.0f};
+    }
+
+    // texture lookups for every face of the busiest terrain chunk, then per face meshing of the chunk
+    void faceLookup(){
+        const int rounds = 2000;
+        const int meshRounds = 1000;
+
+        // surface chunk with the most faces in the column at 0, 0
+        Chunk * none[27] = {};
+        ChunkSnapshot * snapshot = new ChunkSnapshot();
+        Chunk * chunk = nullptr;
+        int chunkFaces = -1;
+        for(int y = 0; y < 8; y++){
+            Chunk * candidate = new Chunk(terrainGenerator.generateChunk(glm::vec3(0, y, 0)));
+            ChunkMeshData mesh;
+            candidate->snapshot(none, *snapshot);
+            Chunk::createMesh(*snapshot, FACE_MESHER, false, mesh);
+            if(mesh.vertexCount / 4 > chunkFaces){
+                delete chunk;
+                chunk = candidate;
+                chunkFaces = mesh.vertexCount / 4;
+            } else {
+                delete candidate;
+            }
+        }
+
+        // block type and face of every face the mesher emits, missing neighbours are air
+        std::vector<std::pair<int, int>> faces;
+        for(int x = 0; x < 16; x++){
+            for(int y = 0; y < 16; y++){
+                for(int z = 0; z < 16; z++){
+                    int type = chunk->getBlock(x, y, z);
+                    if(type == 0) continue;
+                    for(int face = 0; face < 6; face++){
+                        int nx = x + faceDirection[face][0];
+                        int ny = y + faceDirection[face][1];
+                        int nz = z + faceDirection[face][2];
+                        bool inside = nx >= 0 && nx < 16 && ny >= 0 && ny < 16 && nz >= 0 && nz < 16;
+                        if(!inside || atlas.isFaceVisible(type, chunk->getBlock(nx, ny, nz), false)) faces.push_back(std::make_pair(type, face));
+                    }
+                }
+            }
+        }
+
+        std::unordered_map<int, std::array<int, 6>> blockMap;
+        for(int type = Atlas::GRASS; type <= Atlas::Glass; type++){
+            for(int face = 0; face < 6; face++) blockMap[type][face] = atlas.getTextureIndex(type, face);
+        }
+
+        long lookups = (long) faces.size() * rounds;
+        double sum = 0;
+        double oldNs = timeNs(lookups, [&]{
+            for(int r = 0; r < rounds; r++){
+                for(auto & face : faces){
+                    std::vector<float> uv = oldBlockCoordinates(blockMap, face.first, face.second);
+                    sum += uv[0] + uv[1];
+                }
+            }
+        });
+
+        double newNs = timeNs(lookups, [&]{
+            for(int r = 0; r < rounds; r++){
+                for(auto & face : faces) sum += atlas.getTextureIndex(face.first, face.second);
+            }
+        });
+        printResult("texture lookup (per face)", "map + vector", oldNs, "table", newNs);
+        printf("  faces/s: %.0fM -> %.0fM\n", 1e3 / oldNs, 1e3 / newNs);
+
+        ChunkMeshData mesh;
+        chunk->snapshot(none, *snapshot);
+        double meshNs = timeNs((long) chunkFaces * meshRounds, [&]{
+            for(int r = 0; r < meshRounds; r++) Chunk::createMesh(*snapshot, FACE_MESHER, false, mesh);
+        });
+        printf("%-26s %d faces, %.2f ns per face, %.1fM faces/s\n", "mesh terrain chunk", chunkFaces, meshNs, 1e3 / meshNs);
+
+        // keep results live
+        printf("  (%zu faces, checksum %.0f)\n", faces.size(), sum);
+        delete chunk;
+        delete snapshot;
+    }
+
+    // snapshot of one chunk, then per face meshing of it with each face mesher, neighbours as given
+    // then both again with ambient occlusion to show what the corner shading costs
+    // best of a few alternating runs, meshing is short enough for one slow run to swamp the average
+    void compareMeshers(const char * name, Chunk * chunk, Chunk * neighbours[27]){
+        const int rounds = 500;
+        const int runs = 8;
+        ChunkSnapshot * snapshot = new ChunkSnapshot();
+        ChunkMeshData faceMesh;
+        ChunkMeshData bitmaskMesh;
+
+        double snapshotNs = 1e30;
+        double faceNs = 1e30;
+        double bitmaskNs = 1e30;
+        double faceOcclusionNs = 1e30;
+        double bitmaskOcclusionNs = 1e30;
+        for(int run = 0; run < runs; run++){
+            snapshotNs = std::min(snapshotNs, timeNs(rounds, [&]{
+                for(int r = 0; r < rounds; r++) chunk->snapshot(neighbours, *snapshot);
+            }));
+            faceNs = std::min(faceNs, timeNs(rounds, [&]{
+                for(int r = 0; r < rounds; r++) Chunk::createMesh(*snapshot, FACE_MESHER, false, faceMesh);
+            }));
+            bitmaskNs = std::min(bitmaskNs, timeNs(rounds, [&]{
+                for(int r = 0; r < rounds; r++) Chunk::createMesh(*snapshot, BITMASK_MESHER, false, bitmaskMesh);
+            }));
+            faceOcclusionNs = std::min(faceOcclusionNs, timeNs(rounds, [&]{
+                for(int r = 0; r < rounds; r++) Chunk::createMesh(*snapshot, FACE_MESHER, true, faceMesh);
+            }));
+            bitmaskOcclusionNs = std::min(bitmaskOcclusionNs, timeNs(rounds, [&]{
+                for(int r = 0; r < rounds; r++) Chunk::createMesh(*snapshot, BITMASK_MESHER, true, bitmaskMesh);
+            }));
+        }
+
+        printResult(name, "per block", faceNs, "bitmask", bitmaskNs);
+        printf("  quads: %d vs %d, snapshot (main thread): %.0f ns\n", faceMesh.vertexCount / 4, bitmaskMesh.vertexCount / 4, snapshotNs);
+        printf("  ambient occlusion: per block %.0f ns (%+.0f%%), bitmask %.0f ns (%+.0f%%)\n",
+            faceOcclusionNs, 100.0 * (faceOcclusionNs / faceNs - 1.0), bitmaskOcclusionNs, 100.0 * (bitmaskOcclusionNs / bitmaskNs - 1.0));
+        delete snapshot;
+    }
+
+    // terrain chunks meshed by the per block and bitmask face meshers
+    // grass: surface chunk with its generated neighbours
+    // stone: stone chunk with no neighbours, every border face shows
+    // mixed: surface chunk with a quarter of its blocks swapped for random types, glass and leaves included
+    void meshKernels(){
+        glm::vec3 surface(0, 3, 0);
+        Chunk * neighbours[27];
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++) neighbours[neighbourIndex(dx, dy, dz)] = new Chunk(terrainGenerator.generateChunk(surface + glm::vec3(dx, dy, dz)));
+            }
+        }
+        Chunk * none[27] = {};
+
+        Chunk grass = terrainGenerator.generateChunk(surface);
+        Chunk stone = terrainGenerator.generateChunk(glm::vec3(0, 1, 0));
+        Chunk mixed = terrainGenerator.generateChunk(surface);
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> coordinate(0, 15);
+        std::uniform_int_distribution<int> type(0, Atlas::Glass);
+        for(int i = 0; i < Chunk::VOLUME / 4; i++) mixed.setBlock(coordinate(rng), coordinate(rng), coordinate(rng), type(rng));
+        mixed.updateSummary();
+
+        compareMeshers("mesh grass chunk", &grass, neighbours);
+        compareMeshers("mesh stone chunk", &stone, none);
+        compareMeshers("mesh mixed chunk", &mixed, neighbours);
+
+        for(Chunk * neighbour : neighbours) delete neighbour;
+    }
+
+    // light of a block of terrain chunks from scratch, then single edits updated incrementally
+    // edits in the middle chunks: a lamp placed in the air over the ground and taken away,
+    // and a stone block placed in sunlight over the ground and taken away, shading the column under it
+    void lightPropagation(){
+        const int width = 6;
+        const int height = 8;
+        const int edits = 200;
+        ChunkMap map;
+        LightEngine engine(map, &atlas);
+        std::vector<Chunk*> chunks;
+
+        // spread until settled, and forget changed chunks as ChunkManager does after remeshing them
+        long steps = 0;
+        auto settle = [&]{
+            while(!engine.isIdle()) steps += engine.propagate(1 << 20);
+            for(ChunkKey key : engine.getChangedChunks()) map.find(key)->clearLightChanged();
+            engine.getChangedChunks().clear();
+        };
+
+        for(int x = 0; x < width; x++){
+            for(int z = 0; z < width; z++){
+                for(int y = 0; y < height; y++) chunks.push_back(new Chunk(terrainGenerator.generateChunk(glm::vec3(x, y, z))));
+            }
+        }
+
+        // chunks arrive bottom up as streaming mostly sees them
+        double fullNs = timeNs(1, [&]{
+            for(Chunk * chunk : chunks){
+                glm::vec3 position = chunk->getPosition();
+                map.insert(chunkKey(position.x, position.y, position.z), chunk);
+                engine.addChunk(chunk);
+            }
+            settle();
+        });
+        long fullSteps = steps;
+
+        auto setBlock = [&](int x, int y, int z, int type){
+            Chunk * chunk = map.find(chunkKey(x >> 4, y >> 4, z >> 4));
+            int old = chunk->getBlock(x & 15, y & 15, z & 15);
+            chunk->setBlock(x & 15, y & 15, z & 15, type);
+            engine.blockChanged(chunk, Chunk::blockIndex(x & 15, y & 15, z & 15), old, type);
+            settle();
+        };
+
+        // ground height of a column, from the chunk map
+        auto ground = [&](int x, int z){
+            int y = height * 16 - 1;
+            while(y > 0 && map.find(chunkKey(x >> 4, y >> 4, z >> 4))->getBlock(x & 15, y & 15, z & 15) == 0) y--;
+            return y;
+        };
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> coordinate(32, width * 16 - 33);
+        double editNs[4] = {};
+        long editSteps[4] = {};
+        for(int i = 0; i < edits; i++){
+            int x = coordinate(rng);
+            int z = coordinate(rng);
+            int y = ground(x, z) + 3;
+            int types[4] = {Atlas::Lamp, 0, Atlas::STONE, 0};
+            for(int e = 0; e < 4; e++){
+                steps = 0;
+                editNs[e] += timeNs(1, [&]{ setBlock(x, y, z, types[e]); });
+                editSteps[e] += steps;
+            }
+        }
+
+        printf("%-26s %d chunks: %.2f ms, %ld voxel steps after the sunlit columns\n", "light from scratch",
+            (int) chunks.size(), fullNs / 1e6, fullSteps);
+        const char * names[4] = {"place lamp", "remove lamp", "place in sunlight", "remove in sunlight"};
+        for(int e = 0; e < 4; e++){
+            printf("  %-20s %7.1f us, %5ld voxel steps, %.0fx faster than from scratch\n", names[e],
+                editNs[e] / edits / 1e3, editSteps[e] / edits, fullNs * edits / editNs[e]);
+        }
+
+        for(Chunk * chunk : chunks) delete chunk;
+    }
+
+    // terrain height noise for 16x16 chunk columns, stb one sample per call against perlinNoiseGrid
+    // at the terrain frequency, where neighbouring samples share lattice cells, and at a high one where they don't
+    void noiseGrid(){
+        const int chunks = 4096;
+        const int samples = chunks * 16 * 16;
+        const float frequencies[2] = {0.05f, 1.37f};
+        const char * names[2] = {"noise terrain 16x16", "noise high freq 16x16"};
+        std::vector<float> scalar(samples);
+        std::vector<float> batched(samples);
+
+        for(int f = 0; f < 2; f++){
+            float frequency = frequencies[f];
+            double scalarNs = timeNs(samples, [&]{
+                for(int c = 0; c < chunks; c++){
+                    float originX = (c % 64 - 32) * 16.0f;
+                    float originZ = (c / 64 - 32) * 16.0f;
+                    for(int z = 0; z < 16; z++){
+                        for(int x = 0; x < 16; x++){
+                            scalar[c * 256 + z * 16 + x] = stb_perlin_noise3_seed((x + originX) * frequency, 3.0f, (z + originZ) * frequency, 0, 0, 0, 1337);
+                        }
+                    }
+                }
+            });
+            double batchedNs = timeNs(samples, [&]{
+                for(int c = 0; c < chunks; c++){
+                    float originX = (c % 64 - 32) * 16.0f;
+                    float originZ = (c / 64 - 32) * 16.0f;
+                    perlinNoiseGrid(originX, 3.0f, originZ, frequency, 16, 16, 1337, &batched[c * 256]);
+                }
+            });
+
+            int different = 0;
+            for(int i = 0; i < samples; i++) different += scalar[i] != batched[i];
+            printResult(names[f], "stb", scalarNs, "grid", batchedNs);
+            printf("  samples/s: %.0fM -> %.0fM, %d of %d samples differ from stb\n", 1e3 / scalarNs, 1e3 / batchedNs, different, samples);
+        }
+    }
+
+    // face connectivity of a chunk meshed on its own, see Chunk::findConnectivity
+    FaceConnectivity connectivityOf(Chunk * chunk){
+        Chunk * none[27] = {};
+        ChunkSnapshot * snapshot = new ChunkSnapshot();
+        ChunkMeshData mesh;
+        chunk->snapshot(none, *snapshot);
+        Chunk::createMesh(*snapshot, BITMASK_MESHER, false, mesh);
+        chunk->setMesh(mesh);
+        delete snapshot;
+        return mesh.connectivity;
+    }
+
+    bool checkConnectivity(const char * name, const FaceConnectivity & found, const FaceConnectivity & expected){
+        bool match = std::equal(found.faces, found.faces + 6, expected.faces);
+        printf("  %-32s %s\n", name, match ? "ok" : "FAILED");
+        if(!match){
+            for(int a = 0; a < 6; a++){
+                printf("    face %d:", a);
+                for(int b = 0; b < 6; b++) printf(" %d/%d", found.isConnected(a, b), expected.isConnected(a, b));
+                printf("   (found/expected)\n");
+            }
+        }
+        return match;
+    }
+
+    bool checkReached(const char * name, Chunk * chunk, int frame, bool expected){
+        bool reached = chunk->wasReached(frame);
+        printf("  %-32s %s\n", name, reached == expected ? "ok" : "FAILED");
+        return reached == expected;
+    }
+
+    // cave culling runs on the cpu, so it is checked here without a gpu
+    // sealed: stone with a hollow in the middle, no face sees another
+    // open: stone with a tunnel along x and a shaft from it up to the top, the x faces and the top see each other
+    // then the visibility walk from an air chunk at 0,0,0 along x, through the sealed or the open chunk at 1,0,0
+    // walks never step back against a direction, so the air chunk at 2,0,0 is only reachable through 1,0,0
+    bool caveCulling(){
+        printf("cave culling checks\n");
+        bool passed = true;
+
+        Chunk * sealed = new Chunk(glm::vec3(1, 0, 0), &atlas, Atlas::STONE);
+        for(int x = 4; x < 12; x++){
+            for(int y = 4; y < 12; y++){
+                for(int z = 4; z < 12; z++) sealed->setBlock(x, y, z, Atlas::AIR);
+            }
+        }
+        sealed->updateSummary();
+
+        Chunk * open = new Chunk(glm::vec3(1, 0, 0), &atlas, Atlas::STONE);
+        for(int x = 0; x < 16; x++) open->setBlock(x, 8, 8, Atlas::AIR);
+        for(int y = 8; y < 16; y++) open->setBlock(8, y, 8, Atlas::AIR);
+        open->updateSummary();
+
+        // faces as faceDirection: 2 top, 4 +x, 5 -x
+        FaceConnectivity openFaces;
+        openFaces.connect(2, 4);
+        openFaces.connect(2, 5);
+        openFaces.connect(4, 5);
+        passed &= checkConnectivity("sealed cave connects no faces", connectivityOf(sealed), FaceConnectivity());
+        passed &= checkConnectivity("tunnel connects x faces and top", connectivityOf(open), openFaces);
+
+        Chunk * camera = new Chunk(glm::vec3(0, 0, 0), &atlas, Atlas::AIR);
+        Chunk * behind = new Chunk(glm::vec3(2, 0, 0), &atlas, Atlas::AIR);
+        ChunkManager manager(terrainGenerator);
+        manager.chunkMap.insert(chunkKey(0, 0, 0), camera);
+        manager.chunkMap.insert(chunkKey(2, 0, 0), behind);
+
+        // looking along x from behind the camera chunk, all three chunks in view
+        Frustum frustum;
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
+        frustum.update(projection * glm::lookAt(glm::vec3(-40, 8, 8), glm::vec3(24, 8, 8), glm::vec3(0, 1, 0)));
+        glm::vec3 eye(8, 8, 8);
+
+        manager.chunkMap.insert(chunkKey(1, 0, 0), sealed);
+        manager.findReachableChunks(eye, frustum, 1);
+        passed &= checkReached("camera chunk reached", camera, 1, true);
+        passed &= checkReached("sealed chunk reached", sealed, 1, true);
+        passed &= checkReached("chunk behind sealed hidden", behind, 1, false);
+
+        manager.chunkMap.erase(chunkKey(1, 0, 0));
+        manager.chunkMap.insert(chunkKey(1, 0, 0), open);
+        manager.findReachableChunks(eye, frustum, 2);
+        passed &= checkReached("chunk behind tunnel reached", behind, 2, true);
+
+        manager.chunkMap.erase(chunkKey(0, 0, 0));
+        manager.chunkMap.erase(chunkKey(1, 0, 0));
+        manager.chunkMap.erase(chunkKey(2, 0, 0));
+        delete camera;
+        delete sealed;
+        delete open;
+        delete behind;
+        return passed;
+    }
+
+public:
+    // returns false if a check failed
+    bool run(){
+        printf("Benchmarks\n");
+        chunkLookup();
+        faceLookup();
+        meshKernels();
+        lightPropagation();
+        noiseGrid();
+        return caveCulling();
+    }
+};
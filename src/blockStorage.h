@@ -0,0 +1,127 @@
+#pragma once
+#include "header.h"
+#include <cstdint>
+
+/*
+Block Storage
+palette compressed block ids for one chunk
+
+uniform chunks (all air, all stone) store a single value and no grid
+mixed chunks store a small palette of block ids and a bit packed index per voxel into it
+index width grows 1 -> 2 -> 4 -> 8 bits as setBlock adds types, widths are powers of 2
+so an index never straddles two words
+
+voxels use the chunk index order, see Chunk::blockIndex
+*/
+
+// block id stored per voxel, block types fit in a byte
+typedef uint8_t BlockID;
+
+class BlockStorage {
+private:
+    int volume;
+    int bits = 0;                   // bits per index, 0 when uniform
+    BlockID uniform = 0;            // value of every voxel when uniform
+
+    std::vector<BlockID> palette;   // block id for each index
+    std::vector<uint32_t> data;     // packed indices, 32 / bits per word
+
+    // word and bit offset of a voxel index
+    int wordOf(int i) const {
+        return (i * bits) >> 5;
+    }
+
+    int shiftOf(int i) const {
+        return (i * bits) & 31;
+    }
+
+    uint32_t mask() const {
+        return (1u << bits) - 1;
+    }
+
+    int readIndex(int i) const {
+        return (data[wordOf(i)] >> shiftOf(i)) & mask();
+    }
+
+    void writeIndex(int i, uint32_t index){
+        uint32_t & word = data[wordOf(i)];
+        word = (word & ~(mask() << shiftOf(i))) | (index << shiftOf(i));
+    }
+
+    // repack indices at a new width
+    void grow(int newBits){
+        std::vector<uint32_t> old;
+        old.swap(data);
+        int oldBits = bits;
+        uint32_t oldMask = (1u << oldBits) - 1;
+
+        bits = newBits;
+        data.assign((volume * bits + 31) / 32, 0);
+        for(int i = 0; i < volume; i++){
+            int bit = i * oldBits;
+            writeIndex(i, (old[bit >> 5] >> (bit & 31)) & oldMask);
+        }
+    }
+
+    // palette index of a type, adding it (and widening indices) if new
+    int paletteIndex(BlockID type){
+        for(int i = 0; i < (int) palette.size(); i++){
+            if(palette[i] == type) return i;
+        }
+        if((int) palette.size() == (1 << bits)) grow(bits * 2);
+        palette.push_back(type);
+        return palette.size() - 1;
+    }
+
+public:
+    BlockStorage(int volume, BlockID type = 0) : volume(volume), uniform(type) {}
+
+    bool isUniform() const {
+        return bits == 0;
+    }
+
+    // value of every voxel, only valid when uniform
+    BlockID getUniform() const {
+        return uniform;
+    }
+
+    BlockID get(int i) const {
+        if(bits == 0) return uniform;
+        return palette[readIndex(i)];
+    }
+
+    void set(int i, BlockID type){
+        if(bits == 0){
+            if(type == uniform) return;
+
+            // first differing block, switch to 1 bit indices, all voxels index 0
+            bits = 1;
+            palette.push_back(uniform);
+            data.assign((volume + 31) / 32, 0);
+        }
+        writeIndex(i, paletteIndex(type));
+    }
+
+    // decode all voxels into out (volume entries) in index order, used by the mesher
+    void unpack(BlockID * out) const {
+        if(bits == 0){
+            std::fill(out, out + volume, uniform);
+            return;
+        }
+
+        int perWord = 32 / bits;
+        uint32_t m = mask();
+        int i = 0;
+        for(uint32_t word : data){
+            for(int j = 0; j < perWord && i < volume; j++, i++){
+                out[i] = palette[word & m];
+                word >>= bits;
+            }
+        }
+    }
+
+    // bytes used including heap allocations
+    size_t memoryUsage() const {
+        return sizeof(BlockStorage) + palette.capacity() * sizeof(BlockID) + data.capacity() * sizeof(uint32_t);
+    }
+};
@@ -1,14 +1,31 @@
 #pragma once
 #include "header.h"
 #include "atlas.h"
+#include "mesh.h"
+#include "blockStorage.h"
+#include "lightStorage.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
 Chunk
-stores blocks in chunk [16][16][16]
+stores blocks in chunk 16x16x16, palette compressed (see BlockStorage)
+index = (x * HEIGHT + y) * LENGTH + z, so z is contiguous, then y, then x
+mesher unpacks blocks into a flat array and loops x, y, z in that order to walk memory in order
 
 stores block rendering information
 uses atlas to get block texture coordinates for mesh
-creates/cache mesh data for solid and transparent blocks
+meshing reads a ChunkSnapshot, the blocks plus a one block border from the neighbours copied on the main thread,
+so meshing jobs don't touch live chunks and the meshers have no chunk border cases
+creates mesh data for solid and transparent blocks through per thread MeshBuilders
+meshers: one quad per visible face, or greedy which merges coplanar faces of the same type
+the per face quads are found either by checking each blocks neighbours, or from row bitmasks (see createBitmaskMesh)
+meshing also flood fills see through voxels to find which chunk faces connect, see FaceConnectivity
+face corners can be shaded by ambient occlusion from the opaque blocks around them, see faceOcclusion
+stores sky and block light per voxel (see LightStorage), filled by LightEngine
+each face is lit by the light of the block in front of it, see faceLight
+mesh is uploaded to gpu once after createMesh, Render draws from the chunks own buffers
 
 
 */
@@ -23,214 +40,847 @@ float vertices[6][4][3] = {
     { {0,0,0}, {0,0,1}, {0,1,1}, {0,1,0} }  // Left
 };
 
-// need seperate uv coordinates for each face due to orientation 
-float uv[6][4][2] = {
-    // Front face
-    {{0.0f, 1.0f}, {0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}},
+// texture coordinates and brightness per face are derived in shader.vert from the packed vertex
 
-    // Back face
-    {{0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f}},
 
-    // Top face
-    {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f},{0.0f, 1.0f}},
+// direction each face points, used to find the neighbouring block
+int faceDirection[6][3] = {
+    {0, 0, -1}, {0, 0, 1}, {0, 1, 0}, {0, -1, 0}, {1, 0, 0}, {-1, 0, 0}
+};
 
-    // Bottom face
-    {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}},
+// axis the face points along, x = 0, y = 1, z = 2
+int faceAxis[6] = {2, 2, 1, 1, 0, 0};
 
-    // Right face
-    {{1.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 1.0f}},
+using std::vector;
 
-    // Left face
-    {{0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f}}
+// per chunk summary flags, lets meshing and rendering skip chunks without scanning voxels
+// updated by Chunk::updateSummary after generation and edits
+struct ChunkSummary {
+    bool empty = true;              // only air
+    bool fullOpaque = false;        // every voxel opaque
+    bool faceSolid[6] = {};         // boundary layer of face fully opaque, faces as mesher (back, front, top, bottom, right, left)
 };
 
-// const float indicies[2][3] = {
-//     {0, 1, 2},
-//     {0, 2, 3}
-// };
+// index of the chunk at offset dx, dy, dz (each -1..1) in the 27 chunks around and including a chunk
+inline int neighbourIndex(int dx, int dy, int dz){
+    return (dx + 1) * 9 + (dy + 1) * 3 + dz + 1;
+}
+
+// copy of a chunk and a one block border from the 26 chunks around it, all a mesher reads
+// taken on the main thread by Chunk::snapshot, so meshing jobs never touch live chunks
+// coordinates run -1..16 on each axis in the chunks x, y, z order, missing neighbours are air in full sunlight
+struct ChunkSnapshot {
+    static const int SIZE = 18;
+    static const int VOLUME = SIZE * SIZE * SIZE;
+    static const uint8_t OUTSIDE_LIGHT = LightStorage::MAX_LEVEL;     // sky 15, block 0
+
+    BlockID blocks[VOLUME];
+    uint8_t light[VOLUME];      // packed as LightStorage
+    glm::vec3 position;
+    const Atlas * atlas = nullptr;
+    bool cullLeaves = false;    // faces between two leaf blocks are hidden, see Atlas::cullsSameType
+    bool empty = false;         // chunk is only air
+    bool skipped = false;       // nothing visible from summaries, blocks not copied, see Chunk::isMeshEmpty
 
+    static int index(int x, int y, int z){
+        return ((x + 1) * SIZE + y + 1) * SIZE + z + 1;
+    }
 
-// brightness for block face - front, back, top, bottom, right, left
-float brightness[6] = {0.86f, 0.86f, 1.0f, 1.0f, 0.8f, 0.8f};
+    // index offset to the block across a face
+    static int step(int face){
+        return (faceDirection[face][0] * SIZE + faceDirection[face][1]) * SIZE + faceDirection[face][2];
+    }
+};
 
-using std::vector;
+// ambient occlusion lookups, see Chunk::faceOcclusion
+// ring: snapshot index offsets from a block to the 8 blocks around the one its face looks at
+// levels: corner levels packed 2 bits each in vertices order, for each opaque mask of the ring
+struct OcclusionTable {
+    int ring[6][8];
+    uint8_t levels[6][256];
+
+    OcclusionTable(){
+        for(int face = 0; face < 6; face++){
+            int n = faceAxis[face];
+            int u = (n + 1) % 3;
+            int v = (n + 2) % 3;
+
+            // ring blocks by their step along u and v
+            int slot[3][3];
+            int k = 0;
+            for(int du = -1; du <= 1; du++){
+                for(int dv = -1; dv <= 1; dv++){
+                    if(du == 0 && dv == 0) continue;
+                    int d[3] = {faceDirection[face][0], faceDirection[face][1], faceDirection[face][2]};
+                    d[u] = du;
+                    d[v] = dv;
+                    ring[face][k] = (d[0] * ChunkSnapshot::SIZE + d[1]) * ChunkSnapshot::SIZE + d[2];
+                    slot[du + 1][dv + 1] = k++;
+                }
+            }
 
+            // a corner is shaded by the two ring blocks beside it and the one diagonal to it
+            // two sides make it fully dark whatever the diagonal is, 3 is unshaded
+            for(int mask = 0; mask < 256; mask++){
+                int packed = 0;
+                for(int corner = 0; corner < 4; corner++){
+                    int du = vertices[face][corner][u] > 0 ? 1 : -1;
+                    int dv = vertices[face][corner][v] > 0 ? 1 : -1;
+                    int side1 = (mask >> slot[du + 1][1]) & 1;
+                    int side2 = (mask >> slot[1][dv + 1]) & 1;
+                    int diagonal = (mask >> slot[du + 1][dv + 1]) & 1;
+                    int level = side1 && side2 ? 0 : 3 - side1 - side2 - diagonal;
+                    packed |= level << (corner * 2);
+                }
+                levels[face][mask] = packed;
+            }
+        }
+    }
+};
 
+const OcclusionTable occlusionTable;
 
+// every corner of a face unshaded, see Chunk::faceOcclusion
+const int NO_OCCLUSION = 0xff;
 
-class Chunk {
-    const int LENGTH = 16;
-    const int WIDTH = 16;
-    const int HEIGHT = 16;
 
-    vector<vector<vector<int>>> blocks;
-    glm::vec3 position;
 
-    std::vector<float> solidVerticies;
-    std::vector<unsigned int> solidIndicies;
 
-    std::vector<float> transparentVerticies;
-    std::vector<unsigned int> transparentIndicies;
+class Chunk {
+public:
+    static const int WIDTH = 16;     // x
+    static const int HEIGHT = 16;    // y
+    static const int LENGTH = 16;    // z
+    static const int VOLUME = WIDTH * HEIGHT * LENGTH;
+
+    // index strides in the flat block array
+    static const int X_STRIDE = HEIGHT * LENGTH;
+    static const int Y_STRIDE = LENGTH;
+
+private:
+    BlockStorage blocks;        // see index order above
+    LightStorage light;         // same index order
+    glm::vec3 position;
+    ChunkSummary summary;
+
+    Mesh solidMesh;
+    Mesh transparentMesh;
+    MeshData transparentData;   // cpu copy of transparent quads, re-sorted as the camera moves
+    glm::vec3 sortCell;         // camera cell the transparent quads are sorted for
+    bool transparentSorted = false;
+    OcclusionQuery occlusionQuery;
+    FaceConnectivity connectivity = FaceConnectivity::all();   // everything connects until meshed
+    int reachedFrame = -1;      // last frame the visibility walk reached this chunk
+    int vertexCount = 0;    // verticies in last built mesh, kept after cpu data is released
+    bool meshSkipped = false;   // last mesh was skipped using summaries
+    int meshVersion = 0;        // bumped for each mesh request, 0 until first requested
+    bool dirty = false;         // edited since last mesh, waiting for the next remesh batch
+    bool lightChanged = false;  // light changed since last mesh, see LightEngine
 
     Atlas * atlas;
 
 public:
-    Chunk(glm::vec3 position, Atlas * atlas) : position(position) {
-        blocks = vector<vector<vector<int>>>(LENGTH, vector<vector<int>>(WIDTH, vector<int>(HEIGHT, 0)));
+    Chunk(glm::vec3 position, Atlas * atlas) : blocks(VOLUME, 0), light(VOLUME), position(position) {
         this->atlas = atlas;
     }
     
 
-    Chunk(glm::vec3 position, Atlas * atlas, int type) : position(position) {
-        blocks = vector<vector<vector<int>>>(LENGTH, vector<vector<int>>(WIDTH, vector<int>(HEIGHT, type)));
+    Chunk(glm::vec3 position, Atlas * atlas, int type) : blocks(VOLUME, type), light(VOLUME), position(position) {
         this->atlas = atlas;
     }
 
-    vector<vector<vector<int>>> getBlocks(){
+    glm::vec3 getPosition(){
+        return position;
+    }
+
+    // index into flat block array
+    static int blockIndex(int x, int y, int z){
+        return (x * HEIGHT + y) * LENGTH + z;
+    }
+
+    // read only view of block storage, no copy
+    const BlockStorage & getBlocks() const {
         return blocks;
     }
 
     
     int getBlock(int x, int y, int z){
-        return blocks[x][y][z];
+        return blocks.get(blockIndex(x, y, z));
+    }
+
+    // sky and block light, written by LightEngine
+    LightStorage & getLight(){
+        return light;
     }
 
+    const LightStorage & getLight() const {
+        return light;
+    }
+
+    // call updateSummary once edits are done
     void setBlock(int x, int y, int z, int type){
-        blocks[x][y][z] = type;
+        blocks.set(blockIndex(x, y, z), type);
+    }
+
+    const ChunkSummary & getSummary() const {
+        return summary;
+    }
+
+    // recompute summary flags, uniform chunks need no scan
+    void updateSummary(){
+        summary = ChunkSummary();
+
+        if(blocks.isUniform()){
+            BlockID type = blocks.getUniform();
+            summary.empty = type == 0;
+            summary.fullOpaque = atlas->isOpaque(type);
+            for(int face = 0; face < 6; face++) summary.faceSolid[face] = summary.fullOpaque;
+            return;
+        }
+
+        BlockID flat[VOLUME];
+        blocks.unpack(flat);
+
+        summary.fullOpaque = true;
+        for(int face = 0; face < 6; face++) summary.faceSolid[face] = true;
+
+        int i = 0;
+        for(int x = 0; x < WIDTH; x++){
+            for(int y = 0; y < HEIGHT; y++){
+                for(int z = 0; z < LENGTH; z++, i++){
+                    if(flat[i] != 0) summary.empty = false;
+                    if(atlas->isOpaque(flat[i])) continue;
+
+                    // see through voxel, breaks any boundary it lies on
+                    summary.fullOpaque = false;
+                    if(z == 0) summary.faceSolid[0] = false;
+                    if(z == LENGTH - 1) summary.faceSolid[1] = false;
+                    if(y == HEIGHT - 1) summary.faceSolid[2] = false;
+                    if(y == 0) summary.faceSolid[3] = false;
+                    if(x == WIDTH - 1) summary.faceSolid[4] = false;
+                    if(x == 0) summary.faceSolid[5] = false;
+                }
+            }
+        }
+    }
+
+    // true if mesh is provably empty from summaries alone
+    // all air, or fully opaque and every neighbour covers the shared face
+    // neighbours indexed by face
+    bool isMeshEmpty(Chunk * neighbours[6]){
+        if(summary.empty) return true;
+        if(!summary.fullOpaque) return false;
+
+        for(int face = 0; face < 6; face++){
+            // opposite face of neighbour touches this one, back <-> front etc
+            if(neighbours[face] == nullptr || !neighbours[face]->getSummary().faceSolid[face ^ 1]) return false;
+        }
+        return true;
+    }
+
+
+    Mesh & getSolidMesh(){
+        return solidMesh;
+    }
+
+    Mesh & getTransparentMesh(){
+        return transparentMesh;
+    }
+
+    int getVertexCount(){
+        return vertexCount;
+    }
+
+    bool wasMeshSkipped(){
+        return meshSkipped;
+    }
+
+    // anything to draw, check after pending uploads
+    bool hasGeometry(){
+        return solidMesh.hasGeometry() || transparentMesh.hasGeometry();
+    }
+
+
+    // new mesh request, results built for older versions are stale
+    int requestMesh(){
+        return ++meshVersion;
+    }
+
+    int getMeshVersion(){
+        return meshVersion;
+    }
+
+    // false if already marked
+    bool markDirty(){
+        if(dirty) return false;
+        dirty = true;
+        return true;
+    }
+
+    void clearDirty(){
+        dirty = false;
+    }
+
+    bool isDirty(){
+        return dirty;
+    }
+
+    // false if already marked
+    bool markLightChanged(){
+        if(lightChanged) return false;
+        lightChanged = true;
+        return true;
+    }
+
+    void clearLightChanged(){
+        lightChanged = false;
     }
 
+    // record a finished mesh, its data is uploaded into getSolidMesh/getTransparentMesh by the caller
+    // keeps a copy of the transparent quads to sort
+    void setMesh(const ChunkMeshData & data){
+        transparentData.verticies = data.transparent.verticies;
+        transparentSorted = false;
 
-    std::vector<float> getSolidVerticies(){
-        return solidVerticies;
+        connectivity = data.connectivity;
+        vertexCount = data.vertexCount;
+        meshSkipped = data.skipped;
     }
 
-    std::vector<unsigned int> getSolidIndicies(){
-        return solidIndicies;
+    const FaceConnectivity & getConnectivity() const {
+        return connectivity;
     }
 
-    std::vector<float> getTransparentVerticies(){
-        return transparentVerticies;
+    void markReached(int frame){
+        reachedFrame = frame;
     }
 
-    std::vector<unsigned int> getTransparentIndicies(){
-        return transparentIndicies;
+    bool wasReached(int frame){
+        return reachedFrame == frame;
     }
 
+    OcclusionQuery & getOcclusionQuery(){
+        return occlusionQuery;
+    }
 
-    // create mesh data for chunk
-    // need to consider other chunks
-    // access manager to get other chunks
-    void createMesh(Chunk * frontChunk, Chunk * backChunk, Chunk * topChunk, Chunk * bottomChunk, Chunk * rightChunk, Chunk * leftChunk){
-        solidVerticies.clear();
-        solidIndicies.clear();
-        transparentVerticies.clear();
-        transparentIndicies.clear();
+    const MeshData & getTransparentData(){
+        return transparentData;
+    }
+
+    // false once the camera moves to another cell or the mesh is rebuilt
+    bool isTransparentSortedFor(glm::vec3 cell){
+        return transparentSorted && cell == sortCell;
+    }
 
-        for(int x = 0; x < LENGTH; x++){
-            for(int y = 0; y < WIDTH; y++){
-                for(int z = 0; z < HEIGHT; z++){
-                    if(blocks[x][y][z] == 0) continue;
+    // order transparent quads back to front from the camera so blending goes far to near
+    // quads are compared by centre distance, cell is recorded for isTransparentSortedFor
+    // render thread only, scratch is shared
+    void sortTransparent(glm::vec3 cameraPosition, glm::vec3 cell){
+        static std::vector<std::pair<float, int>> order;
+        static std::vector<Vertex> sorted;
+
+        std::vector<Vertex> & verticies = transparentData.verticies;
+        int quads = verticies.size() / 4;
+        glm::vec3 origin = position * 16.0f;
+
+        order.resize(quads);
+        for(int q = 0; q < quads; q++){
+            const Vertex * quad = &verticies[q * 4];
+            glm::vec3 centre = (unpackPosition(quad[0].data) + unpackPosition(quad[1].data) + unpackPosition(quad[2].data) + unpackPosition(quad[3].data)) * 0.25f;
+            glm::vec3 offset = origin + centre - cameraPosition;
+            order[q] = std::make_pair(glm::dot(offset, offset), q);
+        }
+
+        // furthest first
+        std::sort(order.begin(), order.end(), [](const std::pair<float, int> & a, const std::pair<float, int> & b){
+            return a.first > b.first;
+        });
+
+        sorted.resize(verticies.size());
+        for(int q = 0; q < quads; q++){
+            std::copy(&verticies[order[q].second * 4], &verticies[order[q].second * 4] + 4, &sorted[q * 4]);
+        }
+        verticies.swap(sorted);
+
+        sortCell = cell;
+        transparentSorted = true;
+    }
+
+
+    // copy the blocks and light and a one block border from the 26 chunks around into out, neighbours by neighbourIndex
+    // main thread, the snapshot can then be meshed on any thread while chunks are edited or unloaded
+    // cullLeaves is the overlay leaf setting, copied so meshing reads no shared state
+    void snapshot(Chunk * neighbours[27], ChunkSnapshot & out, bool cullLeaves = false){
+        out.position = position;
+        out.atlas = atlas;
+        out.cullLeaves = cullLeaves;
+        out.empty = summary.empty;
+
+        // nothing to mesh, blocks aren't read
+        Chunk * faceNeighbours[6];
+        for(int face = 0; face < 6; face++){
+            faceNeighbours[face] = neighbours[neighbourIndex(faceDirection[face][0], faceDirection[face][1], faceDirection[face][2])];
+        }
+        out.skipped = isMeshEmpty(faceNeighbours);
+        if(out.skipped) return;
+
+        // own blocks and light, a line along z at a time
+        BlockID flat[VOLUME];
+        uint8_t flatLight[VOLUME];
+        blocks.unpack(flat);
+        light.unpack(flatLight);
+        for(int x = 0; x < WIDTH; x++){
+            for(int y = 0; y < HEIGHT; y++){
+                int line = (x * HEIGHT + y) * LENGTH;
+                std::copy(flat + line, flat + line + LENGTH, out.blocks + ChunkSnapshot::index(x, y, 0));
+                std::copy(flatLight + line, flatLight + line + LENGTH, out.light + ChunkSnapshot::index(x, y, 0));
+            }
+        }
 
-                    // only add face if visible
-                    // TODO: check if block next to is transparent, then would need to add
-                    // Front face
-                    // for z = 0, check chunk next to, otherwise check block in front
-                    if(z == 0){
-                        if(backChunk == nullptr || backChunk->getBlock(x, y, LENGTH - 1) == 0) addBlockFace(x, y, z, 0, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x][y][z - 1] == 0) addBlockFace(x, y, z, 0, blocks[x][y][z]);
+        // border, each neighbour fills the part of the shell on its side
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++){
+                    if(dx == 0 && dy == 0 && dz == 0) continue;
+                    Chunk * neighbour = neighbours[neighbourIndex(dx, dy, dz)];
+                    bool uniform = neighbour == nullptr || neighbour->getBlocks().isUniform();
+                    BlockID value = neighbour == nullptr ? 0 : neighbour->getBlocks().getUniform();
+                    bool uniformLight = neighbour == nullptr || neighbour->getLight().isUniform();
+                    uint8_t lightValue = neighbour == nullptr ? ChunkSnapshot::OUTSIDE_LIGHT : neighbour->getLight().getUniform();
+
+                    // snapshot coordinates covered, -1 or 16 towards the neighbour, 0..15 along it
+                    int d[3] = {dx, dy, dz};
+                    int from[3], to[3];
+                    for(int axis = 0; axis < 3; axis++){
+                        from[axis] = d[axis] < 0 ? -1 : (d[axis] > 0 ? 16 : 0);
+                        to[axis] = d[axis] == 0 ? 15 : from[axis];
                     }
 
-                   
-                    // Back face
-                    if(z == LENGTH - 1){
-                        if(frontChunk == nullptr || frontChunk->getBlock(x, y, 0) == 0) addBlockFace(x, y, z, 1, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x][y][z + 1] == 0) addBlockFace(x, y, z, 1, blocks[x][y][z]);
+                    for(int x = from[0]; x <= to[0]; x++){
+                        for(int y = from[1]; y <= to[1]; y++){
+                            for(int z = from[2]; z <= to[2]; z++){
+                                int i = ChunkSnapshot::index(x, y, z);
+                                int j = blockIndex(x - dx * WIDTH, y - dy * HEIGHT, z - dz * LENGTH);
+                                out.blocks[i] = uniform ? value : neighbour->getBlocks().get(j);
+                                out.light[i] = uniformLight ? lightValue : neighbour->getLight().getPacked(j);
+                            }
+                        }
                     }
-                    
-                    // Top face
-                    if(y == HEIGHT - 1){
-                        if(topChunk == nullptr || topChunk->getBlock(x, 0, z) == 0) addBlockFace(x, y, z, 2, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x][y + 1][z] == 0) addBlockFace(x, y, z, 2, blocks[x][y][z]);
+                }
+            }
+        }
+    }
+
+
+    // create mesh data for a snapshot into out, reads nothing else so any thread can run it
+    // ambientOcclusion shades face corners, see faceOcclusion
+    static void createMesh(const ChunkSnapshot & snapshot, Mesher mesher, bool ambientOcclusion, ChunkMeshData & out){
+        // quads go to scratch memory reused by every mesh built on this thread
+        // 0 solid, 1 transparent, see addQuad
+        static thread_local MeshBuilder builders[2];
+        uint32_t chunkWord = packChunk(snapshot.position.x, snapshot.position.y, snapshot.position.z);
+        builders[0].reset(chunkWord);
+        builders[1].reset(chunkWord);
+
+        // skip voxel scan when nothing can be visible
+        out.skipped = snapshot.skipped;
+        if(out.skipped){
+            // air sees through every face, an enclosed opaque chunk through none
+            out.connectivity = snapshot.empty ? FaceConnectivity::all() : FaceConnectivity();
+            finishMesh(builders, out);
+            return;
+        }
+
+        findConnectivity(snapshot, out.connectivity);
+
+        if(mesher == GREEDY_MESHER){
+            createGreedyMesh(snapshot, ambientOcclusion, builders);
+            finishMesh(builders, out);
+            return;
+        }
+
+        if(mesher == BITMASK_MESHER){
+            createBitmaskMesh(snapshot, ambientOcclusion, builders);
+            finishMesh(builders, out);
+            return;
+        }
+
+        // every block has all 6 neighbours in the snapshot, so no border cases
+        // i follows x, y, z loop order so the block array is read in memory order
+        const Atlas * atlas = snapshot.atlas;
+        const BlockID * blocks = snapshot.blocks;
+        int steps[6];
+        for(int face = 0; face < 6; face++) steps[face] = ChunkSnapshot::step(face);
+
+        for(int x = 0; x < WIDTH; x++){
+            for(int y = 0; y < HEIGHT; y++){
+                int i = ChunkSnapshot::index(x, y, 0);
+                for(int z = 0; z < LENGTH; z++, i++){
+                    int type = blocks[i];
+                    if(type == 0) continue;
+
+                    // only add face if visible, see Atlas::isFaceVisible
+                    for(int face = 0; face < 6; face++){
+                        if(!atlas->isFaceVisible(type, blocks[i + steps[face]], snapshot.cullLeaves)) continue;
+                        int occlusion = ambientOcclusion ? faceOcclusion(snapshot, i, face) : NO_OCCLUSION;
+                        addBlockFace(atlas, builders, x, y, z, face, type, occlusion, faceLight(snapshot, i + steps[face]));
+                    }
+                }
+            }
+        }
+
+        finishMesh(builders, out);
+    }
+
+    // greedy mesher
+    // for each face direction, builds a 16x16 mask of visible face types per slice
+    // then grows quads along the first axis and then the second while the type matches
+    // brightness and texture only depend on type and face, so equal mask values can merge
+    // the mask also holds the light level and, with ambient occlusion, the corner levels above the type
+    // faces only merge when all 4 corners have the same level, others stay single so the shading isn't stretched
+    static void createGreedyMesh(const ChunkSnapshot & snapshot, bool ambientOcclusion, MeshBuilder * builders){
+        const Atlas * atlas = snapshot.atlas;
+        int mask[16][16];
+
+        for(int face = 0; face < 6; face++){
+            // n is the axis the face points along, u and v span the slice
+            int n = faceAxis[face];
+            int u = (n + 1) % 3;
+            int v = (n + 2) % 3;
+            int step = ChunkSnapshot::step(face);
+
+            for(int slice = 0; slice < WIDTH; slice++){
+                // collect visible faces in slice
+                for(int i = 0; i < WIDTH; i++){
+                    for(int j = 0; j < WIDTH; j++){
+                        int p[3];
+                        p[n] = slice; p[u] = i; p[v] = j;
+
+                        int index = ChunkSnapshot::index(p[0], p[1], p[2]);
+                        int type = snapshot.blocks[index];
+                        if(type != 0 && atlas->isFaceVisible(type, snapshot.blocks[index + step], snapshot.cullLeaves)){
+                            int occlusion = ambientOcclusion ? faceOcclusion(snapshot, index, face) : NO_OCCLUSION;
+                            mask[i][j] = type | occlusion << 8 | faceLight(snapshot, index + step) << 16;
+                        } else {
+                            mask[i][j] = 0;
+                        }
                     }
-             
-                    
-                    // Bottom face
-                    if(y == 0){
-                        if(bottomChunk == nullptr || bottomChunk->getBlock(x, HEIGHT - 1, z) == 0) addBlockFace(x, y, z, 3, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x][y - 1][z] == 0) addBlockFace(x, y, z, 3, blocks[x][y][z]);
+                }
+
+                // merge faces into quads
+                for(int j = 0; j < WIDTH; j++){
+                    for(int i = 0; i < WIDTH;){
+                        int value = mask[i][j];
+                        if(value == 0){
+                            i++;
+                            continue;
+                        }
+                        int type = value & 0xff;
+                        int occlusion = (value >> 8) & 0xff;
+                        int limit = occlusion == (occlusion & 3) * 0x55 ? WIDTH : 1;
+
+                        // grow along u
+                        int w = 1;
+                        while(i + w < WIDTH && w < limit && mask[i + w][j] == value) w++;
+
+                        // grow along v while the whole row matches
+                        int h = 1;
+                        for(; j + h < WIDTH && h < limit; h++){
+                            bool rowMatches = true;
+                            for(int k = 0; k < w; k++){
+                                if(mask[i + k][j + h] != value){
+                                    rowMatches = false;
+                                    break;
+                                }
+                            }
+                            if(!rowMatches) break;
+                        }
+
+                        // clear merged faces
+                        for(int dj = 0; dj < h; dj++){
+                            for(int di = 0; di < w; di++){
+                                mask[i + di][j + dj] = 0;
+                            }
+                        }
+
+                        int p[3], size[3];
+                        p[n] = slice; p[u] = i; p[v] = j;
+                        size[n] = 1; size[u] = w; size[v] = h;
+                        addQuad(atlas, builders, p[0], p[1], p[2], size[0], size[1], size[2], face, type, occlusion, value >> 16);
+
+                        i += w;
                     }
+                }
+            }
+        }
+    }
 
+    // flood fill see through voxels from the chunk borders
+    // every pair of faces touched by one filled region can see each other through the chunk
+    // regions that don't reach a border can't be seen through, so only border voxels start a fill
+    // fills whole rows at once, rows as in createBitmaskMesh: a row region spreads along z inside
+    // its open bits, then into the open bits beside it in the 4 rows around
+    static void findConnectivity(const ChunkSnapshot & snapshot, FaceConnectivity & out){
+        const int ROWS = WIDTH * HEIGHT;
+        uint16_t open[ROWS];
+        uint16_t visited[ROWS] = {};
+        uint16_t frontier[ROWS] = {};    // bits reached but not spread yet
+        int stack[ROWS];
+        out = FaceConnectivity();
+
+        for(int row = 0; row < ROWS; row++){
+            const BlockID * line = snapshot.blocks + ChunkSnapshot::index(row / HEIGHT, row % HEIGHT, 0);
+            int bits = 0xffff;
+            if(nonAirBits(line) != 0){
+                for(int z = 0; z < LENGTH; z++) bits &= ~(snapshot.atlas->isOpaque(line[z]) << z);
+            }
+            open[row] = bits;
+        }
 
+        for(int seedRow = 0; seedRow < ROWS; seedRow++){
+            int seedX = seedRow / HEIGHT;
+            int seedY = seedRow % HEIGHT;
+            bool borderRow = seedX == 0 || seedX == WIDTH - 1 || seedY == 0 || seedY == HEIGHT - 1;
+
+            // inner rows only touch the border at both ends
+            while(int seeds = open[seedRow] & ~visited[seedRow] & (borderRow ? 0xffff : 0x8001)){
+                int touched = 0;    // bit per face
+                int top = 0;
+                frontier[seedRow] = seeds & -seeds;
+                stack[top++] = seedRow;
+
+                while(top > 0){
+                    int row = stack[--top];
+                    int x = row / HEIGHT;
+                    int y = row % HEIGHT;
+
+                    // spread along the row
+                    int bits = frontier[row];
+                    frontier[row] = 0;
+                    int grown;
+                    while((grown = (bits | bits << 1 | bits >> 1) & open[row]) != bits) bits = grown;
+                    visited[row] |= bits;
+
+                    if(bits & 0x0001) touched |= 1 << 0;
+                    if(bits & 0x8000) touched |= 1 << 1;
+                    if(y == HEIGHT - 1) touched |= 1 << 2;
+                    if(y == 0) touched |= 1 << 3;
+                    if(x == WIDTH - 1) touched |= 1 << 4;
+                    if(x == 0) touched |= 1 << 5;
+
+                    // into the rows beside it
+                    int next[4] = {
+                        y < HEIGHT - 1 ? row + 1 : -1,
+                        y > 0 ? row - 1 : -1,
+                        x < WIDTH - 1 ? row + HEIGHT : -1,
+                        x > 0 ? row - HEIGHT : -1
+                    };
+                    for(int n : next){
+                        if(n < 0) continue;
+                        int reached = bits & open[n] & ~visited[n];
+                        if(reached == 0) continue;
+                        if(frontier[n] == 0) stack[top++] = n;
+                        frontier[n] |= reached;
+                    }
+                }
 
-                    // Right face
-                    if(x == WIDTH - 1){
-                        if(rightChunk == nullptr || rightChunk->getBlock(0, y, z) == 0) addBlockFace(x, y, z, 4, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x + 1][y][z] == 0) addBlockFace(x, y, z, 4, blocks[x][y][z]);
+                for(int a = 0; a < 6; a++){
+                    for(int b = a + 1; b < 6; b++){
+                        if((touched >> a & 1) && (touched >> b & 1)) out.connect(a, b);
                     }
+                }
+            }
+        }
+    }
 
+    // bitmask mesher, emits the same quads as the per face mesher
+    // each line of 16 blocks along z at (x, y) is a 16 bit row, bit z per block
+    // opaque and self culling rows include the snapshot border, so the faces of a row visible in one
+    // direction are solid & ~opaque of the next row over, or of the same row shifted for the z directions,
+    // worked out 8 rows at a time with sse2
+    // faces between two blocks of a self culling type are removed afterwards, per block
+    static void createBitmaskMesh(const ChunkSnapshot & snapshot, bool ambientOcclusion, MeshBuilder * builders){
+        const int ROWS = WIDTH * HEIGHT;
+        const int PAD = ChunkSnapshot::SIZE;    // padded rows are indexed (x + 1) * PAD + y + 1
+        const Atlas * atlas = snapshot.atlas;
+        const BlockID * blocks = snapshot.blocks;
+
+        uint16_t solid[ROWS];
+        uint16_t opaque[PAD * PAD];
+        uint16_t cull[PAD * PAD];               // blocks hiding faces against their own type
+        uint16_t opaqueEdge[2][ROWS];           // border block at z = -1 as bit 0, at z = 16 as bit 15
+        uint16_t cullEdge[2][ROWS];
+        uint16_t visible[6][ROWS];
+
+        // rows in one pass over the snapshot, air lines need no property lookups
+        bool anyCull = false;
+        for(int padded = 0; padded < PAD * PAD; padded++){
+            const BlockID * line = blocks + padded * PAD + 1;
+            int solidBits = nonAirBits(line);
+            int opaqueBits = 0;
+            int cullBits = 0;
+            if(solidBits != 0){
+                for(int z = 0; z < LENGTH; z++){
+                    const BlockProperties & p = atlas->getProperties(line[z]);
+                    opaqueBits |= p.opaque << z;
+                    cullBits |= atlas->cullsSameType(line[z], snapshot.cullLeaves) << z;
+                }
+            }
+            opaque[padded] = opaqueBits;
+            cull[padded] = cullBits;
+
+            // rows of this chunk, not the border
+            int x = padded / PAD - 1;
+            int y = padded % PAD - 1;
+            if(x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) continue;
+
+            int row = x * HEIGHT + y;
+            const BlockProperties & back = atlas->getProperties(line[-1]);
+            const BlockProperties & front = atlas->getProperties(line[LENGTH]);
+            solid[row] = solidBits;
+            opaqueEdge[0][row] = back.opaque;
+            opaqueEdge[1][row] = front.opaque << 15;
+            cullEdge[0][row] = atlas->cullsSameType(line[-1], snapshot.cullLeaves);
+            cullEdge[1][row] = atlas->cullsSameType(line[LENGTH], snapshot.cullLeaves) << 15;
+            anyCull |= cullBits != 0;
+        }
 
+        // padded row offset of the next row in each face direction, z faces shift instead
+        const int rowStep[6] = {0, 0, 1, -1, PAD, -PAD};
+
+        for(int x = 0; x < WIDTH; x++){
+#ifdef __SSE2__
+            for(int y = 0; y < HEIGHT; y += 8){
+                int row = x * HEIGHT + y;
+                int padded = (x + 1) * PAD + y + 1;
+                __m128i s = _mm_loadu_si128((const __m128i *) &solid[row]);
+
+                __m128i own = _mm_loadu_si128((const __m128i *) &opaque[padded]);
+                __m128i back = _mm_or_si128(_mm_slli_epi16(own, 1), _mm_loadu_si128((const __m128i *) &opaqueEdge[0][row]));
+                __m128i front = _mm_or_si128(_mm_srli_epi16(own, 1), _mm_loadu_si128((const __m128i *) &opaqueEdge[1][row]));
+                _mm_storeu_si128((__m128i *) &visible[0][row], _mm_andnot_si128(back, s));
+                _mm_storeu_si128((__m128i *) &visible[1][row], _mm_andnot_si128(front, s));
+
+                for(int face = 2; face < 6; face++){
+                    __m128i next = _mm_loadu_si128((const __m128i *) &opaque[padded + rowStep[face]]);
+                    _mm_storeu_si128((__m128i *) &visible[face][row], _mm_andnot_si128(next, s));
+                }
+            }
+#else
+            for(int y = 0; y < HEIGHT; y++){
+                int row = x * HEIGHT + y;
+                int padded = (x + 1) * PAD + y + 1;
+
+                visible[0][row] = solid[row] & ~((opaque[padded] << 1) | opaqueEdge[0][row]);
+                visible[1][row] = solid[row] & ~((opaque[padded] >> 1) | opaqueEdge[1][row]);
+                for(int face = 2; face < 6; face++) visible[face][row] = solid[row] & ~opaque[padded + rowStep[face]];
+            }
+#endif
+        }
 
-                    // Left face
-                    if(x == 0){
-                        if(leftChunk == nullptr || leftChunk->getBlock(WIDTH - 1, y, z) == 0) addBlockFace(x, y, z, 5, blocks[x][y][z]);
-                    } else {
-                        if(blocks[x - 1][y][z] == 0) addBlockFace(x, y, z, 5, blocks[x][y][z]);
+        for(int face = 0; face < 6; face++){
+            int step = ChunkSnapshot::step(face);
+
+            for(int row = 0; row < ROWS; row++){
+                int mask = visible[face][row];
+                if(mask == 0) continue;
+
+                int x = row / HEIGHT;
+                int y = row % HEIGHT;
+                const BlockID * line = blocks + ChunkSnapshot::index(x, y, 0);
+
+                // self culling block against a self culling block, hidden only if the types match
+                if(anyCull){
+                    int padded = (x + 1) * PAD + y + 1;
+                    int next;
+                    if(face == 0) next = (cull[padded] << 1) | cullEdge[0][row];
+                    else if(face == 1) next = (cull[padded] >> 1) | cullEdge[1][row];
+                    else next = cull[padded + rowStep[face]];
+
+                    int both = mask & cull[padded] & next;
+                    while(both != 0){
+                        int z = __builtin_ctz(both);
+                        both &= both - 1;
+                        if(line[z] == line[z + step]) mask &= ~(1 << z);
                     }
+                }
 
+                // one quad per set bit
+                while(mask != 0){
+                    int z = __builtin_ctz(mask);
+                    mask &= mask - 1;
+                    int index = ChunkSnapshot::index(x, y, z);
+                    int occlusion = ambientOcclusion ? faceOcclusion(snapshot, index, face) : NO_OCCLUSION;
+                    addBlockFace(atlas, builders, x, y, z, face, line[z], occlusion, faceLight(snapshot, index + step));
                 }
             }
         }
     }
 
-    void addBlockFace(int x, int y, int z, int face, int type){
-        // accound for chunk position + block position
-        float cord[3] = {(float) x + position.x * WIDTH, (float) y + position.y * HEIGHT, (float) z + position.z * LENGTH};
+    // bit z set for each non air block in a line of 16 blocks along z
+    static int nonAirBits(const BlockID * line){
+#ifdef __SSE2__
+        __m128i blocks = _mm_loadu_si128((const __m128i *) line);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(blocks, _mm_setzero_si128())) ^ 0xffff;
+#else
+        int bits = 0;
+        for(int z = 0; z < LENGTH; z++) bits |= (line[z] != 0) << z;
+        return bits;
+#endif
+    }
 
-        vector<float> offset = atlas->getBlockCoordinates(type, face);
+    // copy built quads out of the thread scratch
+    static void finishMesh(const MeshBuilder * builders, ChunkMeshData & out){
+        builders[0].finish(out.solid);
+        builders[1].finish(out.transparent);
+        out.vertexCount = builders[0].getVertexCount() + builders[1].getVertexCount();
+    }
 
-        vector<float> * verticies;
-        vector<unsigned int> * indicies;
-        if(atlas->isTransparent(type)){
-            verticies = &transparentVerticies;
-            indicies = &transparentIndicies;
-        } else {
-            verticies = &solidVerticies;
-            indicies = &solidIndicies;
-        } 
+    // ambient occlusion of the 4 corners of a face of the block at snapshot index, 2 bits each in vertices order
+    // from which of the 8 blocks around the one the face looks at are opaque, see OcclusionTable
+    static int faceOcclusion(const ChunkSnapshot & snapshot, int index, int face){
+        const Atlas * atlas = snapshot.atlas;
+        const BlockID * outside = snapshot.blocks + index;
+        const int * ring = occlusionTable.ring[face];
+        int mask = 0;
+        for(int k = 0; k < 8; k++) mask |= atlas->isOpaque(outside[ring[k]]) << k;
+        return occlusionTable.levels[face][mask];
+    }
 
-        int indexOffset = verticies->size() / 6;
+    // light level of a face, the brighter of the sky and block light of the block in front of it
+    // there is no day cycle, so the shader doesn't need the two apart
+    static int faceLight(const ChunkSnapshot & snapshot, int outside){
+        uint8_t packed = snapshot.light[outside];
+        return std::max(packed & 15, packed >> 4);
+    }
 
+    static void addBlockFace(const Atlas * atlas, MeshBuilder * builders, int x, int y, int z, int face, int type, int occlusion, int light){
+        addQuad(atlas, builders, x, y, z, 1, 1, 1, face, type, occlusion, light);
+    }
 
+    // add quad covering sx * sy * sz blocks from x, y, z
+    // one of the sizes is 1 (the face normal axis), occlusion as from faceOcclusion, light from faceLight
+    static void addQuad(const Atlas * atlas, MeshBuilder * builders, int x, int y, int z, int sx, int sy, int sz, int face, int type, int occlusion, int light){
+        // position inside the chunk, chunk origin is added in the shader
+        int size[3] = {sx, sy, sz};
+        int tile = atlas->getTextureIndex(type, face);
+        uint32_t corner[4];
 
-        // add face verticies
+        // texture coordinates and brightness come from position and face in the shader
         for(int i = 0; i < 4; i++){
-            // 3 values for x, y, z
-            verticies->push_back(cord[0] + vertices[face][i][0]);
-            verticies->push_back(cord[1] + vertices[face][i][1]);
-            verticies->push_back(cord[2] + vertices[face][i][2]);
-            
-            // 2 values for u, v
-            verticies->push_back(uv[face][i][0] * atlas->UV_WIDTH + offset[0]);
-            verticies->push_back(uv[face][i][1] * atlas->UV_HEIGHT + offset[1]);
-
-            // 1 value for brightness of texture
-            verticies->push_back(brightness[face]);
-        }
-
-        // add face indicies
-        // Add indices for two triangles
-        indicies->push_back(indexOffset);
-        indicies->push_back(indexOffset + 1);
-        indicies->push_back(indexOffset + 2);
-        indicies->push_back(indexOffset);
-        indicies->push_back(indexOffset + 2);
-        indicies->push_back(indexOffset + 3);
-        
+            corner[i] = packVertex(
+                x + (int) vertices[face][i][0] * size[0],
+                y + (int) vertices[face][i][1] * size[1],
+                z + (int) vertices[face][i][2] * size[2],
+                face, tile, (occlusion >> (i * 2)) & 3, light);
+        }
+
+        // the two triangles share the corner 0 to 2 diagonal, the shading is interpolated along it
+        // start from corner 1 when that puts the diagonal between the darker pair, so the shading
+        // doesn't depend on which way round the face was built
+        int a0 = occlusion & 3, a1 = (occlusion >> 2) & 3, a2 = (occlusion >> 4) & 3, a3 = occlusion >> 6;
+        int first = a0 + a2 > a1 + a3;
+        builders[atlas->isTransparent(type)].addQuad(corner[first], corner[first + 1], corner[first + 2], corner[(first + 3) & 3]);
     }
 
 
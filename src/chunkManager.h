@@ -3,104 +3,768 @@
 #include "chunk.h"
 #include "render.h"
 #include "terrainGenerator.h"
+#include "debugStats.h"
+#include "frustum.h"
+#include "threadPool.h"
+#include "chunkMap.h"
+#include "lightEngine.h"
+#include <unordered_set>
 
 
 /*
 Chunk Manager
-stores chunks in single map, with
+stores chunks in single map, keyed by packed 64 bit chunk coordinates (see ChunkMap)
 handles choosing chunks for rendering
 handle chunk generation
 
 when chunk goes into render distance and not generated, generate it
 have a queue of chunks to generate, limit waiting for frame
 
-block placement/removal
+generation and meshing run as jobs on a thread pool, results come back through a completion queue
+a chunk is meshed once it and its face neighbours in the world are generated, with ambient occlusion
+also its edge and corner neighbours inside the load radius, chunks arriving later remesh the meshed ones they shade
+finished meshes are uploaded on the render thread, at most uploadsPerFrame per frame
+
+chunks stream around the camera: missing chunks within render distance + 1 are generated nearest first,
+chunks past render distance + unloadMargin are freed, both capped per frame
+the extra ring gives edge chunks neighbours to mesh against, the margin stops chunks thrashing at the border
 
+rendering queues opaque meshes of visible chunks, then transparent meshes sorted far to near
+quads inside a transparent mesh are re-sorted when the camera moves to another 8 block cell
+optional cave culling: each meshed chunk records which of its faces see each other through
+non opaque blocks, a walk from the camera chunk through connected faces finds what can be seen
+optional occlusion culling: after drawing, each chunk in the frustum has its bounds tested against
+the depth buffer with an occlusion query, chunks whose last box was fully hidden are skipped
+results lag a frame, so a chunk coming out from behind terrain can appear a frame late
 
+block placement/removal
+edits mark their chunk dirty, and the neighbour across any chunk border the block touches
+dirty chunks are remeshed together once per frame on the render thread, so an edit shows the same frame
+and many edits to one chunk cost one remesh
+edits apply at once, meshing jobs read snapshots rather than the chunks
+
+lighting: chunks are lit as they arrive and edits update light incrementally (see LightEngine)
+propagation is capped at lightStepsPerFrame voxels and runs before the edit remesh, so small edits show lit
+chunks whose light changed are remeshed as jobs once the light settles, or every lightRemeshFrames frames
+while it keeps spreading
 */
 
 
 
 class ChunkManager {
 private:
-    const int renderDistance = 5;
+    friend class Benchmark;     // checks the visibility walk on hand built chunks, without a window
+
+    // finished job handed back from a worker, either a generated chunk or a built mesh
+    struct JobResult {
+        glm::vec3 position;
+        Chunk * chunk = nullptr;            // generated chunk, not yet in chunkMap
+        ChunkMeshData * mesh = nullptr;     // built mesh for chunk at position
+        ChunkSnapshot * snapshot = nullptr; // blocks the mesh was built from, returned to the pool
+        int meshVersion = 0;
+    };
+
+    // chunk position reached by the visibility walk, see findReachableChunks
+    struct VisibilityStep {
+        glm::vec3 position;
+        int entryFace;          // face the walk came in through, -1 for the camera chunk
+        int directions;         // bit per face direction stepped so far
+    };
+
     const int worldChunkHeight = 8;                     //16*8 = 256 world height
-    std::unordered_map<int, Chunk*> chunkMap;     // store chunks
-    std::queue<glm::vec3> renderQueue;                  // queue of chunks to render - for efficiency
+    const int uploadsPerFrame = 16;                     // mesh uploads per frame, keeps frame time stable
+    const int loadsPerFrame = 8;                        // generation jobs started per frame
+    const int unloadsPerFrame = 8;                      // chunks freed per frame
+    const int unloadMargin = 3;                         // chunks past render distance kept loaded
+    const int meshDataPoolSize = 64;                    // spare mesh buffers kept for reuse
+    const int sortsPerFrame = 16;                       // transparent meshes re-sorted and uploaded per frame
+    const float sortCellSize = 8.0f;                    // camera moving to another cell re-sorts transparent quads
+    const float occlusionBoxMargin = 0.05f;             // query boxes grow a little so faces on the bounds pass
+    const int occlusionMaxAge = 3;                      // frames an occluded result is trusted
+    const int lightStepsPerFrame = 8192;                // voxels the light engine may visit per frame, around 0.5 ms
+    const int lightRemeshFrames = 8;                    // frames light changes may wait for the light to settle
+    ChunkMap chunkMap;                                  // store chunks
+    std::deque<JobResult> renderQueue;                  // built meshes waiting for upload
+    std::vector<ChunkMeshData*> meshDataPool;           // uploaded mesh buffers, capacity kept for the next mesh
+    std::vector<ChunkSnapshot*> snapshotPool;           // meshing inputs of finished jobs
+    LightEngine lighting;                               // after chunkMap, reads it
+    int lightRemeshWait = 0;                            // frames light changes have waited
     // when generating chunks create their mesh and store in chunk
 
+    TerrainGenerator * terrainGenerator;
+    CompletionQueue<JobResult> completed;               // filled by workers, drained in update
+    ThreadPool pool;                                    // after completed, so workers stop first
+    int jobsInFlight = 0;
+
+    std::unordered_set<ChunkKey> generating;            // chunks with a generation job in flight
+    std::vector<glm::vec3> loadQueue;                   // missing chunks around the camera, nearest last
+    glm::vec3 streamCenter;                             // camera chunk the load queue was built for
+    int streamRadius = -1;                              // load radius the load queue was built for
+
+    std::vector<glm::vec3> dirtyChunks;                 // edited chunks to remesh this frame
+
+    std::vector<std::pair<float, Chunk*>> transparentChunks;   // visible this frame, by camera distance squared
+    std::vector<Chunk*> queryChunks;                    // in frustum this frame, occlusion tested after drawing
+    std::vector<VisibilityStep> visibilityQueue;        // breadth first walk of chunks seen from the camera
+    std::unordered_set<ChunkKey> visibilityVisited;
+    bool occlusionCulled = false;                       // occlusion mode used last frame
+    int frameIndex = 0;
+    std::chrono::high_resolution_clock::time_point lastFrame;
+
+    DebugStats stats;
+    Frustum frustum;
+    Mesher meshedWith = BITMASK_MESHER;                 // mesher used for current meshes
+    bool meshedOcclusion = true;                        // ambient occlusion in current meshes
+    bool meshedLeafCulling = false;                     // leaves culling each other in current meshes
+
+
+    // fixed height, horizontally as far as the vertex chunk word reaches (see packChunk), 32k blocks each way
+    bool isInWorld(glm::vec3 position){
+        return position.y >= 0 && position.y < worldChunkHeight &&
+            position.x >= CHUNK_COORD_MIN && position.x <= CHUNK_COORD_MAX &&
+            position.z >= CHUNK_COORD_MIN && position.z <= CHUNK_COORD_MAX;
+    }
+
+    // squared horizontal distance in chunks, streaming radii are circles around the camera chunk
+    float horizontalDistance2(glm::vec3 a, glm::vec3 b){
+        float dx = a.x - b.x;
+        float dz = a.z - b.z;
+        return dx * dx + dz * dz;
+    }
+
+    // inside the circle of chunks streamChunks generates
+    bool isInLoadRadius(glm::vec3 position){
+        return horizontalDistance2(position, streamCenter) <= streamRadius * streamRadius;
+    }
+
+    bool isPastUnloadRadius(glm::vec3 position){
+        float radius = stats.renderDistance + unloadMargin;
+        return horizontalDistance2(position, streamCenter) > radius * radius;
+    }
+
+    // mesh buffers for a new mesh job, main thread only
+    ChunkMeshData * acquireMeshData(){
+        if(meshDataPool.empty()) return new ChunkMeshData();
+        ChunkMeshData * data = meshDataPool.back();
+        meshDataPool.pop_back();
+        return data;
+    }
+
+    // pool is capped, a burst of loads would otherwise keep every buffer at its peak size
+    void releaseMeshData(ChunkMeshData * data){
+        if((int) meshDataPool.size() < meshDataPoolSize){
+            meshDataPool.push_back(data);
+        } else {
+            delete data;
+        }
+    }
+
+    ChunkSnapshot * acquireSnapshot(){
+        if(snapshotPool.empty()) return new ChunkSnapshot();
+        ChunkSnapshot * snapshot = snapshotPool.back();
+        snapshotPool.pop_back();
+        return snapshot;
+    }
+
+    void releaseSnapshot(ChunkSnapshot * snapshot){
+        if((int) snapshotPool.size() < meshDataPoolSize){
+            snapshotPool.push_back(snapshot);
+        } else {
+            delete snapshot;
+        }
+    }
+
+    // copy a chunk and its border from the chunks around it, main thread
+    ChunkSnapshot * takeSnapshot(Chunk * chunk){
+        glm::vec3 position = chunk->getPosition();
+        Chunk * neighbours[27];
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++) neighbours[neighbourIndex(dx, dy, dz)] = getChunk(position + glm::vec3(dx, dy, dz));
+            }
+        }
+
+        ChunkSnapshot * snapshot = acquireSnapshot();
+        chunk->snapshot(neighbours, *snapshot, meshedLeafCulling);
+        return snapshot;
+    }
+
+    // generate chunk on a worker
+    void queueGenerate(glm::vec3 position){
+        TerrainGenerator * generator = terrainGenerator;
+        jobsInFlight++;
+        pool.submit([this, generator, position]{
+            JobResult result;
+            result.position = position;
+            result.chunk = new Chunk(generator->generateChunk(position));
+            completed.push(result);
+        });
+    }
+
+    // mesh chunk on a worker from a snapshot taken now, the job reads no chunks
+    // so chunks can be edited or unloaded while it runs, stale results are dropped by version
+    void queueMesh(glm::vec3 position){
+        Chunk * chunk = getChunk(position);
+        if(chunk == nullptr) return;
+
+        Mesher mesher = meshedWith;
+        bool occlusion = meshedOcclusion;
+        int version = chunk->requestMesh();
+        ChunkMeshData * mesh = acquireMeshData();
+        ChunkSnapshot * snapshot = takeSnapshot(chunk);
+
+        jobsInFlight++;
+        pool.submit([this, position, mesher, occlusion, version, mesh, snapshot]{
+            auto start = std::chrono::high_resolution_clock::now();
+
+            JobResult result;
+            result.position = position;
+            result.meshVersion = version;
+            result.mesh = mesh;
+            result.snapshot = snapshot;
+            Chunk::createMesh(*snapshot, mesher, occlusion, *result.mesh);
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            result.mesh->buildTimeMs = elapsed.count();
+            completed.push(result);
+        });
+    }
+
+    // first mesh once the chunk and its 6 face neighbours inside the world are generated
+    // with ambient occlusion the edge and corner neighbours shade the border faces too, so those are waited for,
+    // except past the load radius where they are never generated
+    void queueMeshIfReady(glm::vec3 position){
+        Chunk * chunk = getChunk(position);
+        if(chunk == nullptr || chunk->getMeshVersion() != 0) return;
+
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++){
+                    int axes = (dx != 0) + (dy != 0) + (dz != 0);
+                    if(axes == 0 || (axes > 1 && !meshedOcclusion)) continue;
+
+                    glm::vec3 neighbour = position + glm::vec3(dx, dy, dz);
+                    if(!isInWorld(neighbour) || getChunk(neighbour) != nullptr) continue;
+                    if(axes == 1 || isInLoadRadius(neighbour)) return;
+                }
+            }
+        }
+        queueMesh(position);
+    }
+
+    // a generated chunk joined the world, mesh the chunks around it that were waiting for it
+    // meshed ones were built with air where it is, face neighbours always see it,
+    // edge and corner neighbours only through ambient occlusion, those are remeshed
+    void meshAround(glm::vec3 position){
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++){
+                    glm::vec3 neighbourPosition = position + glm::vec3(dx, dy, dz);
+                    Chunk * neighbour = getChunk(neighbourPosition);
+                    if(neighbour == nullptr) continue;
+
+                    int axes = (dx != 0) + (dy != 0) + (dz != 0);
+                    if(neighbour->getMeshVersion() == 0){
+                        queueMeshIfReady(neighbourPosition);
+                    } else if(axes > 0 && (axes == 1 || meshedOcclusion) && !neighbour->isDirty()){
+                        queueMesh(neighbourPosition);
+                    }
+                }
+            }
+        }
+    }
+
+    // move a finished mesh into its chunk and upload it, stale meshes are dropped
+    // returns true if anything was uploaded to the gpu
+    bool applyMesh(Render & render, JobResult & result){
+        Chunk * chunk = getChunk(result.position);
+        bool uploaded = false;
+
+        if(chunk != nullptr && chunk->getMeshVersion() == result.meshVersion){
+            stats.meshVertexCount += result.mesh->vertexCount - chunk->getVertexCount();
+            stats.meshSkippedCount += (int) result.mesh->skipped - (int) chunk->wasMeshSkipped();
+            stats.meshTimeMs += result.mesh->buildTimeMs;
+
+            chunk->setMesh(*result.mesh);
+            render.uploadMesh(chunk->getSolidMesh(), result.mesh->solid);
+            render.uploadMesh(chunk->getTransparentMesh(), result.mesh->transparent);
+            uploaded = chunk->hasGeometry();
+        }
+
+        releaseMeshData(result.mesh);
+        return uploaded;
+    }
+
+    // queue chunk for the next remesh batch, chunks not meshed yet pick up edits when first meshed
+    void markDirty(glm::vec3 position){
+        Chunk * chunk = getChunk(position);
+        if(chunk == nullptr || chunk->getMeshVersion() == 0) return;
+        if(chunk->markDirty()) dirtyChunks.push_back(position);
+    }
+
+    // write block and mark chunks to remesh
+    void applyEdit(glm::vec3 position, int type){
+        glm::vec3 chunkPosition = glm::vec3(floor(position.x / 16), floor(position.y / 16), floor(position.z / 16));
+        glm::vec3 blockPosition = glm::vec3(position.x - chunkPosition.x * 16, position.y - chunkPosition.y * 16, position.z - chunkPosition.z * 16);
+        Chunk * chunk = getChunk(chunkPosition);
+        if(chunk == nullptr) return;    // not loaded, edit is dropped
+
+        int oldType = chunk->getBlock(blockPosition.x, blockPosition.y, blockPosition.z);
+        stats.blockMemoryBytes -= chunk->getBlocks().memoryUsage();
+        chunk->setBlock(blockPosition.x, blockPosition.y, blockPosition.z, type);
+        chunk->updateSummary();
+        stats.blockMemoryBytes += chunk->getBlocks().memoryUsage();
+        lighting.blockChanged(chunk, Chunk::blockIndex(blockPosition.x, blockPosition.y, blockPosition.z), oldType, type);
+
+        // block on a chunk border is also seen by the neighbour across it, and on an edge or corner
+        // it shades the corners of faces in the chunks diagonal to it (ambient occlusion)
+        int local[3] = {(int) blockPosition.x, (int) blockPosition.y, (int) blockPosition.z};
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++){
+                    int d[3] = {dx, dy, dz};
+                    bool touches = true;
+                    for(int axis = 0; axis < 3; axis++){
+                        if(d[axis] != 0 && local[axis] != (d[axis] > 0 ? 15 : 0)) touches = false;
+                    }
+                    if(touches) markDirty(chunkPosition + glm::vec3(dx, dy, dz));
+                }
+            }
+        }
+    }
+
+    // spread queued light within the frame budget, then remesh chunks whose light changed
+    // chunks edited this frame are left to remeshDirty, unmeshed chunks pick the light up when first meshed
+    void propagateLight(){
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.lightSteps = lighting.propagate(lightStepsPerFrame);
+        stats.lightQueued = lighting.queued();
+        stats.lightRemeshes = 0;
+
+        std::vector<ChunkKey> & changed = lighting.getChangedChunks();
+        if(!changed.empty() && (lighting.isIdle() || ++lightRemeshWait >= lightRemeshFrames)){
+            for(ChunkKey key : changed){
+                Chunk * chunk = chunkMap.find(key);
+                if(chunk == nullptr) continue;
+
+                chunk->clearLightChanged();
+                chunk->getLight().compact();
+                if(chunk->getMeshVersion() != 0 && !chunk->isDirty()){
+                    queueMesh(chunk->getPosition());
+                    stats.lightRemeshes++;
+                }
+            }
+            changed.clear();
+            lightRemeshWait = 0;
+        }
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        stats.lightTimeMs = elapsed.count();
+    }
+
+    // remesh each dirty chunk once on this thread and upload it
+    void remeshDirty(Render & render){
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.remeshCount = 0;
+
+        for(glm::vec3 & position : dirtyChunks){
+            Chunk * chunk = getChunk(position);
+            if(chunk == nullptr) continue;
+            chunk->clearDirty();
+
+            auto meshStart = std::chrono::high_resolution_clock::now();
+            JobResult result;
+            result.position = position;
+            result.meshVersion = chunk->requestMesh();
+            result.mesh = acquireMeshData();
+            ChunkSnapshot * snapshot = takeSnapshot(chunk);
+            Chunk::createMesh(*snapshot, meshedWith, meshedOcclusion, *result.mesh);
+            releaseSnapshot(snapshot);
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - meshStart;
+            result.mesh->buildTimeMs = elapsed.count();
+            applyMesh(render, result);
+            stats.remeshCount++;
+        }
+        dirtyChunks.clear();
+
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        stats.remeshTimeMs = elapsed.count();
+    }
+
+    // last occlusion result of a chunk, read without waiting on the gpu
+    // chunks the camera is in, or without a recent result, count as visible
+    bool isOccluded(Render & render, Chunk * chunk, glm::vec3 cameraPosition){
+        OcclusionQuery & query = chunk->getOcclusionQuery();
+        render.readQuery(query);
+
+        glm::vec3 min = chunk->getPosition() * 16.0f - glm::vec3(1.0f);
+        glm::vec3 max = min + glm::vec3(18.0f);
+        bool cameraInside = cameraPosition.x >= min.x && cameraPosition.x <= max.x &&
+                            cameraPosition.y >= min.y && cameraPosition.y <= max.y &&
+                            cameraPosition.z >= min.z && cameraPosition.z <= max.z;
+        if(cameraInside) return false;
+
+        bool recent = query.frame >= frameIndex - occlusionMaxAge;
+        return query.occluded && recent;
+    }
+
+    // wall time between frames, averaged separately with occlusion culling on and off
+    void measureFrameTime(){
+        auto now = std::chrono::high_resolution_clock::now();
+        if(frameIndex > 1){
+            std::chrono::duration<float, std::milli> elapsed = now - lastFrame;
+            float & average = occlusionCulled ? stats.frameTimeOcclusionMs : stats.frameTimeNoOcclusionMs;
+            average = average == 0.0f ? elapsed.count() : average * 0.95f + elapsed.count() * 0.05f;
+        }
+        lastFrame = now;
+    }
+
+    // nearest first list of missing chunks within load radius of center
+    void buildLoadQueue(glm::vec3 center, int radius){
+        loadQueue.clear();
+        for(int x = -radius; x <= radius; x++){
+            for(int z = -radius; z <= radius; z++){
+                if(x * x + z * z > radius * radius) continue;
+
+                for(int y = 0; y < worldChunkHeight; y++){
+                    glm::vec3 position = glm::vec3(center.x + x, y, center.z + z);
+                    if(!isInWorld(position)) continue;
+
+                    ChunkKey key = chunkIndex(position);
+                    if(chunkMap.find(key) != nullptr || generating.count(key) != 0) continue;
+                    loadQueue.push_back(position);
+                }
+            }
+        }
+
+        // sort furthest first so nearest are popped from the back
+        std::sort(loadQueue.begin(), loadQueue.end(), [center](const glm::vec3 & a, const glm::vec3 & b){
+            glm::vec3 da = a - center;
+            glm::vec3 db = b - center;
+            return glm::dot(da, da) > glm::dot(db, db);
+        });
+    }
+
+    // free chunk and its gpu buffers, caller removes it from chunkMap
+    void unloadChunk(Render & render, Chunk * chunk){
+        glm::vec3 position = chunk->getPosition();
+
+        // drop meshes still waiting for upload
+        for(auto it = renderQueue.begin(); it != renderQueue.end();){
+            if(it->position == position){
+                releaseMeshData(it->mesh);
+                it = renderQueue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        stats.blockMemoryBytes -= chunk->getBlocks().memoryUsage();
+        stats.meshVertexCount -= chunk->getVertexCount();
+        stats.meshSkippedCount -= (int) chunk->wasMeshSkipped();
+
+        render.deleteMesh(chunk->getSolidMesh());
+        render.deleteMesh(chunk->getTransparentMesh());
+        render.deleteQuery(chunk->getOcclusionQuery());
+        lighting.removeChunk(chunk);
+        delete chunk;
+    }
+
+    // request chunks around the camera and free far ones, each capped per frame
+    void streamChunks(Render & render, glm::vec3 cameraPosition){
+        glm::vec3 center = glm::floor(cameraPosition / 16.0f);
+        int loadRadius = stats.renderDistance + 1;
+
+        // rebuild list of missing chunks when the camera enters a new chunk
+        if(center != streamCenter || loadRadius != streamRadius){
+            streamCenter = center;
+            streamRadius = loadRadius;
+            buildLoadQueue(center, loadRadius);
+
+            // corner neighbours that left the load radius won't arrive, stop waiting for them
+            if(meshedOcclusion){
+                for(auto & entry : chunkMap){
+                    if(entry.value->getMeshVersion() == 0) queueMeshIfReady(entry.value->getPosition());
+                }
+            }
+        }
+
+        stats.chunkLoads = 0;
+        while(!loadQueue.empty() && stats.chunkLoads < loadsPerFrame){
+            glm::vec3 position = loadQueue.back();
+            loadQueue.pop_back();
+
+            ChunkKey key = chunkIndex(position);
+            if(chunkMap.find(key) != nullptr || generating.count(key) != 0) continue;
+
+            generating.insert(key);
+            queueGenerate(position);
+            stats.chunkLoads++;
+        }
+
+        // collected first, erasing moves entries in the map
+        std::vector<Chunk*> unloads;
+        for(auto & entry : chunkMap){
+            if((int) unloads.size() == unloadsPerFrame) break;
+            if(isPastUnloadRadius(entry.value->getPosition())) unloads.push_back(entry.value);
+        }
+
+        for(Chunk * chunk : unloads){
+            chunkMap.erase(chunkIndex(chunk->getPosition()));
+            unloadChunk(render, chunk);
+        }
+        stats.chunkUnloads = unloads.size();
+    }
 
     
     
 public:
     
-    // fix this
-    int chunkIndex(glm::vec3 position){
-        return (position.x * 16 * 16) + (position.y * 16) + position.z;
+    // unique key for chunk coordinates
+    ChunkKey chunkIndex(glm::vec3 position){
+        return chunkKey((int) position.x, (int) position.y, (int) position.z);
     }
 
     Chunk * getChunk(glm::vec3 position){
-        if(chunkMap.count(chunkIndex(position)) == 0){
-            return nullptr;
-        }
-        return chunkMap[chunkIndex(position)];
+        return chunkMap.find(chunkIndex(position));
     }
 
 
-    ChunkManager(TerrainGenerator & terrainGenerator){
-        // generate chunks around 0, 0, 0
-        for(int x = -renderDistance; x < renderDistance; x++){
-            for(int y = 0; y < worldChunkHeight; y++){
-                for(int z = -renderDistance; z < renderDistance; z++){
+    // chunks are generated around the camera on the first update
+    ChunkManager(TerrainGenerator & terrainGenerator) : lighting(chunkMap, terrainGenerator.getAtlas()) {
+        this->terrainGenerator = &terrainGenerator;
+    }
 
-                    // change to queue
-                    glm::vec3 position = glm::vec3(x, y, z);
-                    int index = chunkIndex(position);
-                    //addChunkToQueue(position);
-                    chunkMap[index] = new Chunk(terrainGenerator.generateChunk(position));
-                }
+    // walk outwards from the camera chunk, stepping out of a face only if it connects to the face the walk
+    // came in through, and never back against a direction already stepped, so paths can't bend round
+    // chunks reached are marked for this frame, the rest are hidden behind opaque blocks
+    // missing or unmeshed chunks connect every face, see Chunk::connectivity
+    // cpu only, returns the number of chunks reached
+    int findReachableChunks(glm::vec3 position, const Frustum & frustum, int frame){
+        visibilityQueue.clear();
+        visibilityVisited.clear();
+
+        // camera above or below the world starts at the nearest layer
+        glm::vec3 start = glm::floor(position / 16.0f);
+        start.y = std::min(std::max(start.y, 0.0f), worldChunkHeight - 1.0f);
+        float radius = stats.renderDistance + unloadMargin;
+
+        visibilityQueue.push_back({start, -1, 0});
+        visibilityVisited.insert(chunkKey(start.x, start.y, start.z));
+
+        // queue grows while walking
+        for(size_t head = 0; head < visibilityQueue.size(); head++){
+            VisibilityStep step = visibilityQueue[head];
+            Chunk * chunk = getChunk(step.position);
+            if(chunk != nullptr) chunk->markReached(frame);
+
+            for(int face = 0; face < 6; face++){
+                if(step.directions & (1 << (face ^ 1))) continue;
+                if(step.entryFace >= 0 && chunk != nullptr && !chunk->getConnectivity().isConnected(step.entryFace, face)) continue;
+
+                glm::vec3 next = step.position + glm::vec3(faceDirection[face][0], faceDirection[face][1], faceDirection[face][2]);
+                if(!isInWorld(next) || horizontalDistance2(next, start) > radius * radius) continue;
+
+                ChunkKey key = chunkKey(next.x, next.y, next.z);
+                if(visibilityVisited.count(key) != 0) continue;
+
+                glm::vec3 min = next * 16.0f;
+                if(!frustum.isBoxVisible(min, min + glm::vec3(16.0f))) continue;
+
+                visibilityVisited.insert(key);
+                // entered through the opposite face of the neighbour
+                visibilityQueue.push_back({next, face ^ 1, step.directions | (1 << face)});
             }
         }
+        return visibilityQueue.size();
+    }
 
-        // change how this works
-        for(int x = -renderDistance; x < renderDistance; x++){
-            for(int y = 0; y < worldChunkHeight; y++){
-                for(int z = -renderDistance; z < renderDistance; z++){
-                    // createMesh(front, back, top, bottom, right, left)
-                    chunkMap[chunkIndex(glm::vec3(x, y, z))]->createMesh(getChunk(glm::vec3(x, y, z + 1)), getChunk(glm::vec3(x, y, z - 1)), getChunk(glm::vec3(x, y + 1, z)), getChunk(glm::vec3(x, y - 1, z)), getChunk(glm::vec3(x + 1, y, z)), getChunk(glm::vec3(x - 1, y, z)));
+    DebugStats & getStats(){
+        return stats;
+    }
+
+    // mesher picked in the overlay
+    Mesher selectedMesher(){
+        if(stats.greedyMeshing) return GREEDY_MESHER;
+        return stats.bitmaskMeshing ? BITMASK_MESHER : FACE_MESHER;
+    }
+
+    // remesh all chunks with the selected mesher, mesh time restarts to total the new meshes
+    void meshWorld(){
+        meshedWith = selectedMesher();
+        meshedOcclusion = stats.ambientOcclusion;
+        meshedLeafCulling = stats.leafCulling;
+        stats.meshTimeMs = 0.0f;
+
+        // chunks not yet meshed will use the new mesher when ready
+        for(auto & entry : chunkMap){
+            if(entry.value->getMeshVersion() != 0) queueMesh(entry.value->getPosition());
+        }
+    }
+
+    // stream chunks, handle finished jobs and upload meshes, called once per frame on the render thread
+    void update(Render & render, glm::vec3 cameraPosition){
+        streamChunks(render, cameraPosition);
+
+        JobResult result;
+        while(completed.pop(result)){
+            jobsInFlight--;
+            if(result.snapshot != nullptr){
+                releaseSnapshot(result.snapshot);
+                result.snapshot = nullptr;
+            }
+
+            if(result.chunk != nullptr){
+                generating.erase(chunkIndex(result.position));
+
+                // camera moved away while generating
+                if(isPastUnloadRadius(result.position)){
+                    delete result.chunk;
+                    continue;
                 }
+
+                chunkMap.insert(chunkIndex(result.position), result.chunk);
+                stats.blockMemoryBytes += result.chunk->getBlocks().memoryUsage();
+                lighting.addChunk(result.chunk);
+
+                // this chunk or a neighbour may now have everything needed to mesh
+                meshAround(result.position);
+            } else {
+                renderQueue.push_back(result);
             }
         }
+
+        propagateLight();
+        remeshDirty(render);
+
+        // upload within budget, empty meshes don't count as they need no gpu work
+        int uploads = 0;
+        while(!renderQueue.empty() && uploads < uploadsPerFrame){
+            if(applyMesh(render, renderQueue.front())) uploads++;
+            renderQueue.pop_front();
+        }
+
+        stats.chunksLoaded = chunkMap.size();
+
+        // light grids come and go as light spreads, summed rather than tracked
+        stats.lightMemoryBytes = 0;
+        for(auto & entry : chunkMap) stats.lightMemoryBytes += entry.value->getLight().memoryUsage();
+        stats.jobsInFlight = jobsInFlight;
+        stats.jobsQueued = pool.getQueuedJobs();
+        stats.uploadsPending = renderQueue.size();
+        stats.workerThreads = pool.getThreadCount();
+
+        VertexArena::Stats arena = render.getArenaStats();
+        stats.arenaUsedBytes = (size_t) arena.used * sizeof(Vertex);
+        stats.arenaCapacityBytes = (size_t) arena.capacity * sizeof(Vertex);
+        stats.arenaUtilisation = arena.utilisation;
+        stats.arenaFreeRanges = arena.freeRanges;
+        stats.arenaFragmentation = arena.fragmentation;
     }
 
     void renderWorld(Render & render, glm::vec3 position, glm::mat4 viewMatrix){
+        frameIndex++;
+        measureFrameTime();
+
+        // mesher changed in overlay, rebuild meshes
+        if(selectedMesher() != meshedWith || stats.ambientOcclusion != meshedOcclusion || stats.leafCulling != meshedLeafCulling) meshWorld();
+
+        // results from before a toggle are stale, start with everything visible
+        if(stats.occlusionCulling != occlusionCulled){
+            occlusionCulled = stats.occlusionCulling;
+            for(auto & entry : chunkMap){
+                OcclusionQuery & query = entry.value->getOcclusionQuery();
+                query.pending = false;
+                query.occluded = false;
+            }
+        }
+
         // check if chunks need to be generated 
+        update(render, position);
 
 
         // render 3d scene based on position
+        // opaque meshes in any order, transparent meshes after them far to near
+        stats.chunksDrawn = 0;
+        stats.chunksCulled = 0;
+        stats.chunksOccluded = 0;
+        stats.chunksHidden = 0;
+        transparentChunks.clear();
+        queryChunks.clear();
+        frustum.update(render.getProjectionMatrix() * viewMatrix);
+        if(stats.caveCulling) findReachableChunks(position, frustum, frameIndex);
+
+        for(auto & entry : chunkMap){
+            Chunk * chunk = entry.value;
+
+            // empty, or fully enclosed
+            if(!chunk->hasGeometry()) continue;
+
+            // chunk bounds in world space
+            glm::vec3 min = chunk->getPosition() * 16.0f;
+            if(!frustum.isBoxVisible(min, min + glm::vec3(16.0f))){
+                stats.chunksCulled++;
+                continue;
+            }
 
+            // no see through path from the camera
+            if(stats.caveCulling && !chunk->wasReached(frameIndex)){
+                stats.chunksHidden++;
+                continue;
+            }
 
-        for(int x = -renderDistance; x < renderDistance; x++){
-            for(int y = 0; y < worldChunkHeight; y++){
-                for(int z = -renderDistance; z < renderDistance; z++){
-                    glm::vec3 position = glm::vec3(x, y, z);
-                    int index = chunkIndex(position);
-                    if(chunkMap.count(index) != 0){
-                        render.renderData(viewMatrix, chunkMap[index]->getSolidVerticies(), chunkMap[index]->getSolidIndicies(), false);
-                        render.renderData(viewMatrix, chunkMap[index]->getTransparentVerticies(), chunkMap[index]->getTransparentIndicies(), true);
-                    }
+            if(occlusionCulled){
+                queryChunks.push_back(chunk);
+                if(isOccluded(render, chunk, position)){
+                    stats.chunksOccluded++;
+                    continue;
                 }
             }
+
+            render.queueDraw(chunk->getSolidMesh(), false);
+            if(chunk->getTransparentMesh().hasGeometry()){
+                glm::vec3 offset = min + glm::vec3(8.0f) - position;
+                transparentChunks.push_back(std::make_pair(glm::dot(offset, offset), chunk));
+            }
+            stats.chunksDrawn++;
         }
-    }
 
-    // add chunk to render queue
-    void addChunkToQueue(glm::vec3 position){
-        renderQueue.push(position);
-    }
+        std::sort(transparentChunks.begin(), transparentChunks.end(), [](const std::pair<float, Chunk*> & a, const std::pair<float, Chunk*> & b){
+            return a.first > b.first;
+        });
+
+        // quads inside a chunk only change order when the camera changes cell
+        // nearest chunks first, their errors are the most visible
+        glm::vec3 cell = glm::floor(position / sortCellSize);
+        stats.transparentSorts = 0;
+        for(auto it = transparentChunks.rbegin(); it != transparentChunks.rend() && stats.transparentSorts < sortsPerFrame; ++it){
+            Chunk * chunk = it->second;
+            if(chunk->isTransparentSortedFor(cell)) continue;
+
+            chunk->sortTransparent(position, cell);
+            render.uploadMesh(chunk->getTransparentMesh(), chunk->getTransparentData());
+            stats.transparentSorts++;
+        }
+
+        for(auto & entry : transparentChunks) render.queueDraw(entry.second->getTransparentMesh(), true);
+        stats.transparentChunks = transparentChunks.size();
+
+        stats.drawCalls = render.drawQueue(viewMatrix);
 
-    std::queue<glm::vec3> getRenderQueue(){
-        return renderQueue;
+        // test boxes against this frames depth, results are used next frame or later
+        // a query still in flight is not reissued
+        if(occlusionCulled){
+            render.beginOcclusionQueries(viewMatrix);
+            for(Chunk * chunk : queryChunks){
+                OcclusionQuery & query = chunk->getOcclusionQuery();
+                if(query.pending) continue;
+
+                glm::vec3 min = chunk->getPosition() * 16.0f - glm::vec3(occlusionBoxMargin);
+                render.queryBox(query, min, min + glm::vec3(16.0f + 2 * occlusionBoxMargin), frameIndex);
+            }
+            render.endOcclusionQueries();
+        }
     }
 
     int getBlock(glm::vec3 position){
@@ -113,15 +777,9 @@ public:
 
 
     // place block
+    // mesh is rebuilt in the next update
     void placeBlock(glm::vec3 position, int type) {
-        glm::vec3 chunkPosition = glm::vec3(floor(position.x / 16), floor(position.y / 16), floor(position.z / 16));
-        glm::vec3 blockPosition = glm::vec3(position.x - chunkPosition.x * 16, position.y - chunkPosition.y * 16, position.z - chunkPosition.z * 16);
-        Chunk * chunk = getChunk(chunkPosition);
-        if(chunk == nullptr) return;
-        chunk->setBlock(blockPosition.x, blockPosition.y, blockPosition.z, type);
-
-        // upate mesh
-
+        applyEdit(position, type);
     }
 
     // place block 0
@@ -130,10 +788,31 @@ public:
     }
 
 
-    void destroy(){
+    // free chunks and their gpu buffers, call before render is destroyed
+    void destroy(Render & render){
+        // stop workers first, they finish queued jobs so every mesh and snapshot ends up in completed
+        pool.shutdown();
+
+        JobResult result;
+        while(completed.pop(result)){
+            delete result.chunk;
+            delete result.mesh;
+            delete result.snapshot;
+        }
+        for(JobResult & pending : renderQueue) delete pending.mesh;
+        renderQueue.clear();
+        for(ChunkMeshData * data : meshDataPool) delete data;
+        meshDataPool.clear();
+        for(ChunkSnapshot * snapshot : snapshotPool) delete snapshot;
+        snapshotPool.clear();
+
         for(auto &chunk : chunkMap){
-            delete chunk.second;
+            render.deleteMesh(chunk.value->getSolidMesh());
+            render.deleteMesh(chunk.value->getTransparentMesh());
+            render.deleteQuery(chunk.value->getOcclusionQuery());
+            delete chunk.value;
         }
+        chunkMap.clear();
     } 
 
 
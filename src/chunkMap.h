@@ -0,0 +1,165 @@
+#pragma once
+#include "header.h"
+#include <cstdint>
+
+/*
+Chunk Map
+open addressing hash map from packed chunk coordinates to chunks
+
+key packs signed x, y, z chunk coordinates into 21 bits each, unique for |coordinate| < 2^20
+slots are a flat array probed linearly, so a lookup is one hash and usually one cache line
+neighbouring chunks hash to unrelated slots, the multiply spreads the low coordinate bits
+erase shifts later entries back instead of leaving tombstones, so probe chains stay short
+with streaming loads and unloads
+*/
+
+class Chunk;
+
+typedef uint64_t ChunkKey;
+
+inline ChunkKey chunkKey(int x, int y, int z){
+    const uint64_t mask = (1u << 21) - 1;
+    return ((uint64_t) (x & mask) << 42) | ((uint64_t) (y & mask) << 21) | (uint64_t) (z & mask);
+}
+
+
+class ChunkMap {
+public:
+    struct Entry {
+        ChunkKey key;
+        Chunk * value;      // nullptr marks an empty slot
+    };
+
+private:
+    std::vector<Entry> slots;   // size is a power of 2
+    size_t count = 0;
+    int shift = 64;             // 64 - log2(slots.size())
+
+    // fibonacci hashing, top bits of key * 2^64 / golden ratio
+    size_t slotOf(ChunkKey key) const {
+        return (key * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    size_t mask() const {
+        return slots.size() - 1;
+    }
+
+    void rehash(size_t capacity){
+        std::vector<Entry> old;
+        old.swap(slots);
+        slots.assign(capacity, Entry{0, nullptr});
+
+        shift = 64;
+        for(size_t size = capacity; size > 1; size >>= 1) shift--;
+
+        count = 0;
+        for(Entry & entry : old){
+            if(entry.value != nullptr) insert(entry.key, entry.value);
+        }
+    }
+
+public:
+    // iterates occupied slots, don't insert or erase while iterating
+    class Iterator {
+        Entry * current;
+        Entry * end;
+
+        void skipEmpty(){
+            while(current != end && current->value == nullptr) current++;
+        }
+
+    public:
+        Iterator(Entry * current, Entry * end) : current(current), end(end) {
+            skipEmpty();
+        }
+
+        Entry & operator*() const {
+            return *current;
+        }
+
+        Iterator & operator++(){
+            current++;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator!=(const Iterator & other) const {
+            return current != other.current;
+        }
+    };
+
+    ChunkMap(){
+        rehash(64);
+    }
+
+    Iterator begin(){
+        return Iterator(slots.data(), slots.data() + slots.size());
+    }
+
+    Iterator end(){
+        return Iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // nullptr if not present
+    Chunk * find(ChunkKey key) const {
+        for(size_t i = slotOf(key);; i = (i + 1) & mask()){
+            const Entry & entry = slots[i];
+            if(entry.value == nullptr) return nullptr;
+            if(entry.key == key) return entry.value;
+        }
+    }
+
+    // insert or replace, value must not be nullptr
+    void insert(ChunkKey key, Chunk * value){
+        // keep load under half so probe chains stay short
+        if((count + 1) * 2 > slots.size()) rehash(slots.size() * 2);
+
+        for(size_t i = slotOf(key);; i = (i + 1) & mask()){
+            Entry & entry = slots[i];
+            if(entry.value == nullptr){
+                entry.key = key;
+                entry.value = value;
+                count++;
+                return;
+            }
+            if(entry.key == key){
+                entry.value = value;
+                return;
+            }
+        }
+    }
+
+    // backward shift deletion, returns false if not present
+    bool erase(ChunkKey key){
+        size_t i = slotOf(key);
+        while(true){
+            if(slots[i].value == nullptr) return false;
+            if(slots[i].key == key) break;
+            i = (i + 1) & mask();
+        }
+
+        // pull back later entries of the chain that could have used the hole
+        size_t hole = i;
+        for(size_t j = (i + 1) & mask(); slots[j].value != nullptr; j = (j + 1) & mask()){
+            size_t home = slotOf(slots[j].key);
+            // entry stays if its home lies cyclically in (hole, j]
+            bool stays = hole <= j ? (hole < home && home <= j) : (hole < home || home <= j);
+            if(stays) continue;
+
+            slots[hole] = slots[j];
+            hole = j;
+        }
+
+        slots[hole].value = nullptr;
+        count--;
+        return true;
+    }
+
+    void clear(){
+        rehash(64);
+    }
+};
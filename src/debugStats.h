@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+Debug Stats
+counters and toggles shared between the world and the imgui overlay
+ChunkManager fills in the counters, ImGuiWrapper shows them and edits the toggles
+*/
+
+struct DebugStats {
+    // streaming
+    int renderDistance = 5;         // setting, chunks around the camera to load and draw
+    int chunksLoaded = 0;
+    int chunkLoads = 0;             // generation jobs started last frame
+    int chunkUnloads = 0;           // chunks freed last frame
+
+    // memory
+    size_t blockMemoryBytes = 0;    // block storage of all chunks
+    size_t lightMemoryBytes = 0;    // light storage of all chunks
+    size_t arenaUsedBytes = 0;      // chunk verticies in the shared vertex buffer
+    size_t arenaCapacityBytes = 0;
+    float arenaUtilisation = 0.0f;      // share of the arena capacity in use
+    int arenaFreeRanges = 0;
+    float arenaFragmentation = 0.0f;    // share of free space outside the largest free range
+
+    // meshing
+    bool greedyMeshing = false;     // toggle, world is remeshed when changed
+    bool bitmaskMeshing = true;     // toggle, per face meshes found from row bitmasks instead of per block checks
+    bool ambientOcclusion = true;   // toggle, face corners shaded by the blocks around them
+    bool leafCulling = false;       // toggle, faces between two leaf blocks are hidden
+    int meshVertexCount = 0;        // verticies in all chunk meshes
+    float meshTimeMs = 0.0f;        // worker time spent on meshes since the last world remesh
+    int meshSkippedCount = 0;       // chunks skipped from summary flags, empty or enclosed
+    int remeshCount = 0;            // edited chunks remeshed last frame
+    float remeshTimeMs = 0.0f;      // time spent remeshing them on the render thread
+
+    // lighting
+    int lightSteps = 0;             // voxels the light engine spread or cleared last frame
+    int lightQueued = 0;            // voxels waiting for the next frames
+    int lightRemeshes = 0;          // chunks queued for remeshing after their light changed
+    float lightTimeMs = 0.0f;       // time spent propagating light last frame
+
+    // jobs
+    int workerThreads = 0;
+    int jobsInFlight = 0;           // generation and mesh jobs submitted but not handled yet
+    int jobsQueued = 0;             // of those, jobs no worker has started
+    int uploadsPending = 0;         // built meshes waiting for their upload slot
+
+    // rendering
+    int chunksDrawn = 0;            // chunks with geometry drawn last frame
+    int chunksCulled = 0;           // chunks with geometry outside the view frustum
+    int drawCalls = 0;              // multi draw calls for the drawn chunks, one per pass
+    int transparentChunks = 0;      // drawn chunks with transparent quads, sorted far to near
+    int transparentSorts = 0;       // chunks whose transparent quads were re-sorted last frame
+    bool caveCulling = false;       // toggle, draw only chunks reachable from the camera through see through blocks
+    int chunksHidden = 0;           // chunks in the frustum the cave walk didn't reach
+    bool occlusionCulling = false;  // toggle, skip chunks whose bounds were hidden last frame
+    int chunksOccluded = 0;         // chunks in the frustum skipped by occlusion culling
+    float frameTimeOcclusionMs = 0.0f;      // average frame time while occlusion culling is on
+    float frameTimeNoOcclusionMs = 0.0f;    // and while it is off
+};
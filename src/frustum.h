@@ -0,0 +1,45 @@
+#pragma once
+#include "header.h"
+
+/*
+Frustum
+view frustum planes taken from projection * view matrix
+used to cull chunks outside the camera view before drawing
+
+planes are (a, b, c, d) with normals pointing into the frustum
+*/
+
+class Frustum {
+private:
+    glm::vec4 planes[6];    // left, right, bottom, top, near, far
+
+public:
+    Frustum() = default;
+
+    // extract planes from combined matrix (Gribb/Hartmann), glm is column major so row i is m[0][i]..m[3][i]
+    void update(const glm::mat4 & viewProjection){
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; i++){
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        planes[0] = row[3] + row[0];
+        planes[1] = row[3] - row[0];
+        planes[2] = row[3] + row[1];
+        planes[3] = row[3] - row[1];
+        planes[4] = row[3] + row[2];
+        planes[5] = row[3] - row[2];
+    }
+
+    // axis aligned box test, box is outside if its most positive corner is behind any plane
+    bool isBoxVisible(const glm::vec3 & min, const glm::vec3 & max) const {
+        for(int i = 0; i < 6; i++){
+            const glm::vec4 & p = planes[i];
+            float x = p.x > 0 ? max.x : min.x;
+            float y = p.y > 0 ? max.y : min.y;
+            float z = p.z > 0 ? max.z : min.z;
+            if(p.x * x + p.y * y + p.z * z + p.w < 0) return false;
+        }
+        return true;
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "header.h"
+#include "debugStats.h"
 
 class ImGuiWrapper {
 private:
@@ -16,8 +17,8 @@ public:
     // Begin new frame
     void newFrame();
     
-    // Render camera and performance UI
-    void renderUI(const glm::vec3& position, float yaw, float pitch, float averageFps);
+    // Render camera and performance UI, toggles in stats can be changed
+    void renderUI(const glm::vec3& position, float yaw, float pitch, float averageFps, DebugStats& stats);
     
     // Render ImGui
     void render();
@@ -68,16 +69,61 @@ void ImGuiWrapper::newFrame() {
     ImGui::NewFrame();
 }
 
-void ImGuiWrapper::renderUI(const glm::vec3& position, float yaw, float pitch, float averageFps) {
-    // Set ImGui window position and size
+void ImGuiWrapper::renderUI(const glm::vec3& position, float yaw, float pitch, float averageFps, DebugStats& stats) {
+    // Set ImGui window position, sized to contents
     ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
-    ImGui::SetNextWindowSize(ImVec2(250, 80), ImGuiCond_Always);
 
     // Camera and Performance UI
-    ImGui::Begin("Camera and Performance", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+    ImGui::Begin("Camera and Performance", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove);
     ImGui::Text("Position: (%.2f, %.2f, %.2f)", position.x, position.y, position.z);
     ImGui::Text("Yaw = %.2f, Pitch = %.2f", yaw, pitch);
     ImGui::Text("FPS: %.1f (%.1f)", averageFps, ImGui::GetIO().Framerate);
+
+    // Streaming
+    ImGui::Separator();
+    ImGui::SliderInt("Render distance", &stats.renderDistance, 2, 16);
+    ImGui::Text("Chunks loaded: %d (+%d, -%d)", stats.chunksLoaded, stats.chunkLoads, stats.chunkUnloads);
+
+    // Memory
+    ImGui::Separator();
+    ImGui::Text("Block memory: %.1f KB", stats.blockMemoryBytes / 1024.0f);
+    ImGui::Text("Light memory: %.1f KB", stats.lightMemoryBytes / 1024.0f);
+    ImGui::Text("Vertex arena: %.1f / %.1f MB (%.0f%%)", stats.arenaUsedBytes / (1024.0f * 1024.0f), stats.arenaCapacityBytes / (1024.0f * 1024.0f),
+        stats.arenaUtilisation * 100.0f);
+    ImGui::Text("Arena free ranges: %d, fragmentation: %.0f%%", stats.arenaFreeRanges, stats.arenaFragmentation * 100.0f);
+
+    // Meshing
+    ImGui::Separator();
+    ImGui::Checkbox("Greedy meshing", &stats.greedyMeshing);
+    ImGui::Checkbox("Bitmask face mesher", &stats.bitmaskMeshing);
+    ImGui::Checkbox("Ambient occlusion", &stats.ambientOcclusion);
+    ImGui::Checkbox("Cull inner leaf faces", &stats.leafCulling);
+    ImGui::Text("Mesh verticies: %d", stats.meshVertexCount);
+    ImGui::Text("Mesh time: %.2f ms", stats.meshTimeMs);
+    ImGui::Text("Chunks skipped: %d", stats.meshSkippedCount);
+    ImGui::Text("Remeshes: %d (%.2f ms)", stats.remeshCount, stats.remeshTimeMs);
+
+    // Lighting
+    ImGui::Separator();
+    ImGui::Text("Light steps: %d (%.2f ms), queued: %d", stats.lightSteps, stats.lightTimeMs, stats.lightQueued);
+    ImGui::Text("Light remeshes: %d", stats.lightRemeshes);
+
+    // Jobs
+    ImGui::Separator();
+    ImGui::Text("Workers: %d, jobs in flight: %d (%d queued)", stats.workerThreads, stats.jobsInFlight, stats.jobsQueued);
+    ImGui::Text("Uploads pending: %d", stats.uploadsPending);
+
+    // Rendering
+    ImGui::Separator();
+    ImGui::Text("Chunks drawn: %d, culled: %d", stats.chunksDrawn, stats.chunksCulled);
+    ImGui::Text("Draw calls: %d", stats.drawCalls);
+    ImGui::Text("Transparent chunks: %d, re-sorted: %d", stats.transparentChunks, stats.transparentSorts);
+    ImGui::Checkbox("Cave culling", &stats.caveCulling);
+    ImGui::Text("Chunks hidden: %d", stats.chunksHidden);
+    ImGui::Checkbox("Occlusion culling", &stats.occlusionCulling);
+    ImGui::Text("Chunks occluded: %d", stats.chunksOccluded);
+    ImGui::Text("Frame time: %.2f ms on, %.2f ms off (%+.2f ms)", stats.frameTimeOcclusionMs, stats.frameTimeNoOcclusionMs,
+        stats.frameTimeOcclusionMs - stats.frameTimeNoOcclusionMs);
     ImGui::End();
 }
 
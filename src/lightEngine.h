@@ -0,0 +1,347 @@
+#pragma once
+#include "header.h"
+#include "chunk.h"
+#include "chunkMap.h"
+#include <deque>
+
+/*
+Light Engine
+flood fills sky and block light through the loaded chunks, values are kept per chunk in LightStorage
+
+light spreads breadth first from queued voxels through any non opaque block, losing a level per block
+sky light at full level goes straight down without loss, so open columns are lit to the ground
+block light starts at blocks with an emission level, see BlockProperties
+
+a chunk arriving has sunlight filled straight down its open columns at once, no queue needed,
+then the light crossing its borders is queued both ways
+a chunk above that isn't loaded yet counts as open sky, when it arrives any column it shades is removed
+from the chunk below, so terrain loading bottom up is lit right away and fixed up later
+
+edits are incremental: light that came from a changed block is cleared outwards first (remove queue),
+the brighter voxels met at the edge of the cleared region are queued to fill it back in (add queue)
+propagate does at most a given number of voxels a call and carries the rest over to the next frame
+removals finish before adds, adding into a part cleared region would spread light that is about to go
+
+chunks whose light changed, and the neighbour across a border voxel that changed, are collected
+for the caller to remesh, each face is lit by the block in front of it so that is all that can change
+*/
+
+class LightEngine {
+private:
+    static const int SKY = LightStorage::SKY;
+    static const int BLOCK = LightStorage::BLOCK;
+    static const int MAX_LEVEL = LightStorage::MAX_LEVEL;
+
+    // face directions as faceDirection
+    static const int UP = 2;
+    static const int DOWN = 3;
+
+    // voxel to spread light from, or to clear light of level from
+    struct LightNode {
+        Chunk * chunk;
+        uint16_t index;
+        uint8_t level;      // light the voxel had before it was cleared, remove queue only
+    };
+
+    ChunkMap & chunkMap;
+    const Atlas * atlas;
+    std::deque<LightNode> addQueue[2];      // by channel
+    std::deque<LightNode> removeQueue[2];
+    std::vector<ChunkKey> changedChunks;
+
+    static ChunkKey keyOf(Chunk * chunk, int dx = 0, int dy = 0, int dz = 0){
+        glm::vec3 position = chunk->getPosition();
+        return chunkKey((int) position.x + dx, (int) position.y + dy, (int) position.z + dz);
+    }
+
+    Chunk * chunkAt(Chunk * chunk, int face){
+        return chunkMap.find(keyOf(chunk, faceDirection[face][0], faceDirection[face][1], faceDirection[face][2]));
+    }
+
+    // voxels across each face of a voxel, in the next chunk at a border, chunk is nullptr if that one isn't loaded
+    void neighbours(Chunk * chunk, int index, Chunk * outChunks[6], int outIndices[6]){
+        static const int strides[3] = {Chunk::X_STRIDE, Chunk::Y_STRIDE, 1};
+        int p[3] = {index >> 8, (index >> 4) & 15, index & 15};
+
+        for(int face = 0; face < 6; face++){
+            int axis = faceAxis[face];
+            int step = faceDirection[face][axis];
+            int coordinate = p[axis] + step;
+
+            if(coordinate >= 0 && coordinate < 16){
+                outChunks[face] = chunk;
+                outIndices[face] = index + step * strides[axis];
+            } else {
+                outChunks[face] = chunkAt(chunk, face);
+                outIndices[face] = index - step * 15 * strides[axis];
+            }
+        }
+    }
+
+    // record a chunk for remeshing, and the chunks across any border the voxel lies on
+    void markChanged(Chunk * chunk, int index){
+        if(chunk->markLightChanged()) changedChunks.push_back(keyOf(chunk));
+
+        int p[3] = {index >> 8, (index >> 4) & 15, index & 15};
+        if(((p[0] + 1) & 14) && ((p[1] + 1) & 14) && ((p[2] + 1) & 14)) return;     // not on a border
+
+        for(int face = 0; face < 6; face++){
+            int axis = faceAxis[face];
+            if(p[axis] != (faceDirection[face][axis] > 0 ? 15 : 0)) continue;
+
+            Chunk * next = chunkAt(chunk, face);
+            if(next != nullptr && next->markLightChanged()) changedChunks.push_back(keyOf(next));
+        }
+    }
+
+    void setLight(Chunk * chunk, int index, int channel, int level){
+        chunk->getLight().set(index, channel, level);
+        markChanged(chunk, index);
+    }
+
+    // spread a voxels light one block in every direction
+    void addStep(int channel, const LightNode & node){
+        int level = node.chunk->getLight().get(node.index, channel);
+        if(level == 0) return;      // cleared since it was queued
+
+        Chunk * chunks[6];
+        int indices[6];
+        neighbours(node.chunk, node.index, chunks, indices);
+        for(int face = 0; face < 6; face++){
+            Chunk * next = chunks[face];
+            int index = indices[face];
+            if(next == nullptr) continue;
+
+            // mostly lit already, light is cheaper to read than the block
+            int spread = channel == SKY && face == DOWN && level == MAX_LEVEL ? MAX_LEVEL : level - 1;
+            if(next->getLight().get(index, channel) >= spread) continue;
+            if(atlas->isOpaque(next->getBlocks().get(index))) continue;
+
+            setLight(next, index, channel, spread);
+            addQueue[channel].push_back({next, (uint16_t) index, 0});
+        }
+    }
+
+    // clear the light around a cleared voxel that came from it, queue brighter light met to fill back in
+    void removeStep(int channel, const LightNode & node){
+        Chunk * chunks[6];
+        int indices[6];
+        neighbours(node.chunk, node.index, chunks, indices);
+        for(int face = 0; face < 6; face++){
+            Chunk * next = chunks[face];
+            int index = indices[face];
+            if(next == nullptr) continue;
+
+            int level = next->getLight().get(index, channel);
+            if(level == 0) continue;
+
+            bool fromHere = level < node.level || (channel == SKY && face == DOWN && node.level == MAX_LEVEL && level == MAX_LEVEL);
+            if(!fromHere){
+                addQueue[channel].push_back({next, (uint16_t) index, 0});
+                continue;
+            }
+
+            setLight(next, index, channel, 0);
+            removeQueue[channel].push_back({next, (uint16_t) index, (uint8_t) level});
+
+            // a light source inside the cleared region shines again
+            int emission = channel == BLOCK ? atlas->getEmission(next->getBlocks().get(index)) : 0;
+            if(emission > 0){
+                setLight(next, index, channel, emission);
+                addQueue[channel].push_back({next, (uint16_t) index, 0});
+            }
+        }
+    }
+
+public:
+    LightEngine(ChunkMap & chunkMap, const Atlas * atlas) : chunkMap(chunkMap), atlas(atlas) {}
+
+    // light a chunk just put in the chunk map
+    void addChunk(Chunk * chunk){
+        LightStorage & light = chunk->getLight();
+        BlockID flat[Chunk::VOLUME];
+        chunk->getBlocks().unpack(flat);
+
+        Chunk * around[6];
+        for(int face = 0; face < 6; face++) around[face] = chunkAt(chunk, face);
+        Chunk * above = around[UP];
+        Chunk * below = around[DOWN];
+
+        // sunlight comes down the columns lit at the bottom of the chunk above, all of them without one
+        bool sunlit[16][16];
+        bool allSunlit = true;
+        for(int x = 0; x < 16; x++){
+            for(int z = 0; z < 16; z++){
+                sunlit[x][z] = above == nullptr || above->getLight().get(Chunk::blockIndex(x, 0, z), SKY) == MAX_LEVEL;
+                allSunlit &= sunlit[x][z];
+            }
+        }
+
+        // lowest sunlit y of each column, 16 if none
+        int litFrom[16][16];
+        const BlockStorage & blocks = chunk->getBlocks();
+        if(allSunlit && blocks.isUniform() && !atlas->isOpaque(blocks.getUniform())){
+            light.fill(SKY, MAX_LEVEL);
+            for(int x = 0; x < 16; x++){
+                for(int z = 0; z < 16; z++) litFrom[x][z] = 0;
+            }
+        } else {
+            for(int x = 0; x < 16; x++){
+                for(int z = 0; z < 16; z++){
+                    int y = 16;
+                    while(sunlit[x][z] && y > 0 && !atlas->isOpaque(flat[Chunk::blockIndex(x, y - 1, z)])){
+                        y--;
+                        light.set(Chunk::blockIndex(x, y, z), SKY, MAX_LEVEL);
+                    }
+                    litFrom[x][z] = y;
+                }
+            }
+        }
+
+        // light sources
+        for(int i = 0; i < Chunk::VOLUME; i++){
+            int emission = atlas->getEmission(flat[i]);
+            if(emission == 0) continue;
+            light.set(i, BLOCK, emission);
+            addQueue[BLOCK].push_back({chunk, (uint16_t) i, 0});
+        }
+
+        // sunlit voxels spread sideways beside darker columns, out to loaded chunks, and down into the one below
+        // horizontal faces are back, front, right, left
+        const int sideFaces[4] = {0, 1, 4, 5};
+        for(int x = 0; x < 16; x++){
+            for(int z = 0; z < 16; z++){
+                for(int y = litFrom[x][z]; y < 16; y++){
+                    bool spreads = y == 0 && below != nullptr;
+                    for(int face : sideFaces){
+                        int nx = x + faceDirection[face][0];
+                        int nz = z + faceDirection[face][2];
+                        if(nx < 0 || nx > 15 || nz < 0 || nz > 15) spreads |= around[face] != nullptr;
+                        else spreads |= y < litFrom[nx][nz];
+                    }
+                    if(spreads) addQueue[SKY].push_back({chunk, (uint16_t) Chunk::blockIndex(x, y, z), 0});
+                }
+            }
+        }
+
+        // light from the loaded chunks around, their layer touching this chunk
+        for(int face = 0; face < 6; face++){
+            Chunk * next = around[face];
+            if(next == nullptr) continue;
+
+            int axis = faceAxis[face];
+            int u = (axis + 1) % 3;
+            int v = (axis + 2) % 3;
+            int p[3];
+            p[axis] = faceDirection[face][axis] > 0 ? 0 : 15;
+            for(int a = 0; a < 16; a++){
+                for(int b = 0; b < 16; b++){
+                    p[u] = a;
+                    p[v] = b;
+                    int index = Chunk::blockIndex(p[0], p[1], p[2]);
+                    for(int channel = 0; channel < 2; channel++){
+                        if(next->getLight().get(index, channel) > 0) addQueue[channel].push_back({next, (uint16_t) index, 0});
+                    }
+                }
+            }
+        }
+
+        // the chunk below took this one as open sky, clear the columns this one shades
+        if(below != nullptr){
+            for(int x = 0; x < 16; x++){
+                for(int z = 0; z < 16; z++){
+                    int top = Chunk::blockIndex(x, 15, z);
+                    if(below->getLight().get(top, SKY) != MAX_LEVEL) continue;
+                    if(light.get(Chunk::blockIndex(x, 0, z), SKY) == MAX_LEVEL) continue;
+
+                    setLight(below, top, SKY, 0);
+                    removeQueue[SKY].push_back({below, (uint16_t) top, MAX_LEVEL});
+                }
+            }
+        }
+    }
+
+    // drop queued work in a chunk about to be freed, light it gave its neighbours stays
+    void removeChunk(Chunk * chunk){
+        for(int channel = 0; channel < 2; channel++){
+            for(std::deque<LightNode> * queue : {&addQueue[channel], &removeQueue[channel]}){
+                queue->erase(std::remove_if(queue->begin(), queue->end(), [chunk](const LightNode & node){
+                    return node.chunk == chunk;
+                }), queue->end());
+            }
+        }
+    }
+
+    // block at index in chunk changed from oldType, call after the chunk holds the new block
+    void blockChanged(Chunk * chunk, int index, int oldType, int newType){
+        LightStorage & light = chunk->getLight();
+
+        // block light here goes, then the new block shines if it can
+        int blockLevel = light.get(index, BLOCK);
+        if(blockLevel > 0){
+            setLight(chunk, index, BLOCK, 0);
+            removeQueue[BLOCK].push_back({chunk, (uint16_t) index, (uint8_t) blockLevel});
+        }
+        int emission = atlas->getEmission(newType);
+        if(emission > 0){
+            setLight(chunk, index, BLOCK, emission);
+            addQueue[BLOCK].push_back({chunk, (uint16_t) index, 0});
+        }
+
+        if(atlas->isOpaque(newType)){
+            // sky light stops here
+            int skyLevel = light.get(index, SKY);
+            if(skyLevel > 0){
+                setLight(chunk, index, SKY, 0);
+                removeQueue[SKY].push_back({chunk, (uint16_t) index, (uint8_t) skyLevel});
+            }
+        } else if(atlas->isOpaque(oldType)){
+            // opened up, light around flows in
+            Chunk * chunks[6];
+            int indices[6];
+            neighbours(chunk, index, chunks, indices);
+            for(int face = 0; face < 6; face++){
+                if(chunks[face] == nullptr) continue;
+                for(int channel = 0; channel < 2; channel++){
+                    if(chunks[face]->getLight().get(indices[face], channel) > 0) addQueue[channel].push_back({chunks[face], (uint16_t) indices[face], 0});
+                }
+            }
+        }
+    }
+
+    // spread queued light over at most budget voxels, returns voxels done
+    // block light first, edits to it are small and seen close up
+    int propagate(int budget){
+        const int channels[2] = {BLOCK, SKY};
+        int steps = 0;
+        for(int channel : channels){
+            while(steps < budget && !removeQueue[channel].empty()){
+                removeStep(channel, removeQueue[channel].front());
+                removeQueue[channel].pop_front();
+                steps++;
+            }
+            if(!removeQueue[channel].empty()) continue;
+
+            while(steps < budget && !addQueue[channel].empty()){
+                addStep(channel, addQueue[channel].front());
+                addQueue[channel].pop_front();
+                steps++;
+            }
+        }
+        return steps;
+    }
+
+    // nothing queued, light is settled
+    bool isIdle() const {
+        return queued() == 0;
+    }
+
+    int queued() const {
+        return addQueue[0].size() + addQueue[1].size() + removeQueue[0].size() + removeQueue[1].size();
+    }
+
+    // chunks whose light changed, caller clears each chunks flag and the list
+    std::vector<ChunkKey> & getChangedChunks(){
+        return changedChunks;
+    }
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include "header.h"
+#include <cstdint>
+
+/*
+Light Storage
+sky and block light for one chunk, 4 bits each packed in a byte per voxel
+low nibble sky light, high nibble block light, see LightStorage::SKY and BLOCK
+
+chunks all in sunlight or all underground hold a single value and no grid,
+the grid is allocated by the first voxel set to a different value
+compact() drops it again once the light settles back to one value
+
+voxels use the chunk index order, see Chunk::blockIndex
+*/
+
+class LightStorage {
+public:
+    // channels, nibble shift is channel * 4
+    static const int SKY = 0;
+    static const int BLOCK = 1;
+    static const int MAX_LEVEL = 15;
+
+private:
+    int volume;
+    uint8_t uniform = 0;            // value of every voxel when there is no grid
+    std::vector<uint8_t> data;
+
+public:
+    LightStorage(int volume) : volume(volume) {}
+
+    bool isUniform() const {
+        return data.empty();
+    }
+
+    // packed value of every voxel, only valid when uniform
+    uint8_t getUniform() const {
+        return uniform;
+    }
+
+    // both channels of a voxel
+    uint8_t getPacked(int i) const {
+        return data.empty() ? uniform : data[i];
+    }
+
+    int get(int i, int channel) const {
+        return (getPacked(i) >> (channel * 4)) & 15;
+    }
+
+    void set(int i, int channel, int level){
+        int shift = channel * 4;
+        uint8_t value = (getPacked(i) & ~(15 << shift)) | (level << shift);
+        if(data.empty()){
+            if(value == uniform) return;
+            data.assign(volume, uniform);
+        }
+        data[i] = value;
+    }
+
+    // set one channel of every voxel, drops the grid if the other channel is uniform too
+    void fill(int channel, int level){
+        int shift = channel * 4;
+        if(data.empty()){
+            uniform = (uniform & ~(15 << shift)) | (level << shift);
+            return;
+        }
+        for(uint8_t & value : data) value = (value & ~(15 << shift)) | (level << shift);
+        compact();
+    }
+
+    // back to a single value if every voxel matches
+    void compact(){
+        if(data.empty()) return;
+        for(uint8_t value : data){
+            if(value != data[0]) return;
+        }
+        uniform = data[0];
+        std::vector<uint8_t>().swap(data);
+    }
+
+    // decode all voxels into out (volume entries) in index order, used by snapshots
+    void unpack(uint8_t * out) const {
+        if(data.empty()){
+            std::fill(out, out + volume, uniform);
+        } else {
+            std::copy(data.begin(), data.end(), out);
+        }
+    }
+
+    // bytes used including heap allocations
+    size_t memoryUsage() const {
+        return sizeof(LightStorage) + data.capacity();
+    }
+};
@@ -13,6 +13,7 @@ Last Update: 2/03/2025
 #include "atlas.h"
 #include "terrainGenerator.h"
 #include "imguiWrapper.h"
+#include "benchmark.h"
 
 
 using namespace std;
@@ -30,7 +31,7 @@ private:
 	Render render;
 	Atlas atlas;
 	TerrainGenerator terrainGenerator = TerrainGenerator(&atlas);
-	ChunkManager chunkManager = ChunkManager(terrainGenerator);
+	ChunkManager chunkManager{terrainGenerator};	// owns a thread pool, can't be copied
 	ImGuiWrapper imGui;
 
 
@@ -83,7 +84,7 @@ public:
 
 		
 		// Create user resources as part of this thread
-		if (!render.init(windowWidth, windowHeight)){
+		if (!render.init(windowWidth, windowHeight, atlas)){
 			std::cerr << "Failed on user create" << std::endl;
 			exit(-1);
 		}
@@ -211,7 +212,7 @@ public:
 
 			// Start the ImGui frame and render UI
 			imGui.newFrame();
-			imGui.renderUI(camera.pos, camera.fYaw, camera.fPitch, average_fps);
+			imGui.renderUI(camera.pos, camera.fYaw, camera.fPitch, average_fps, chunkManager.getStats());
 
 			// Handle Frame Update
 
@@ -244,7 +245,8 @@ public:
 
 		imGui.shutdown();
 
-
+		// free chunk meshes while gl context is alive
+		chunkManager.destroy(render);
 		
 
 		// call destructor for render
@@ -258,7 +260,13 @@ public:
 
 
 
-int main(){
+int main(int argc, char ** argv){
+	// micro benchmarks, no window
+	if(argc > 1 && std::string(argv[1]) == "--bench"){
+		Benchmark benchmark;
+		return benchmark.run() ? 0 : 1;
+	}
+
 	GameEngine3D game(1200, 800);
 
 	game.Run();
@@ -0,0 +1,171 @@
+#pragma once
+#include "header.h"
+#include <cstdint>
+
+/*
+Mesh
+cpu side vertex/index data built by the chunk mesher
+and the gpu buffers it is uploaded to
+
+mesher writes quads into a MeshBuilder, copies them out to MeshData, Render uploads that into a Mesh
+a Mesh is a range of verticies in one vertex buffer shared by all chunks (see VertexArena),
+so every chunk can be drawn with a single multi draw call
+
+meshes are lists of quads, 4 verticies each, so indicies are never built per mesh
+every draw uses one shared index buffer holding base, base+1, base+2, base, base+2, base+3 for every quad
+
+vertices are packed into two 32 bit words, decoded in shader.vert
+data word
+    bits 0-14   position inside the chunk, 5 bits each for x, y, z (0 - 16)
+    bits 15-17  face, selects brightness and which axes the texture follows
+    bits 18-25  atlas tile
+    bits 26-27  ambient occlusion, 0 darkest to 3 unshaded
+    bits 28-31  light level, the brighter of sky and block light in front of the face
+chunk word, the same for every vertex of a mesh, a multi draw can't change a uniform between chunks
+    bits 0-11   chunk x + 2048
+    bits 12-19  chunk y
+    bits 20-31  chunk z + 2048
+    so chunk x and z must stay within CHUNK_COORD_MIN to CHUNK_COORD_MAX (+-32k blocks),
+    past that they would spill into the other fields, ChunkManager::isInWorld ends the world there
+texture coordinates are not stored, the shader takes them from the position on the face plane
+world position is chunk * 16 + local position
+*/
+
+struct Vertex {
+    uint32_t data;
+    uint32_t chunk;
+};
+
+inline uint32_t packVertex(int x, int y, int z, int face, int tile, int occlusion = 3, int light = 15){
+    return (uint32_t) x | ((uint32_t) y << 5) | ((uint32_t) z << 10) | ((uint32_t) face << 15) | ((uint32_t) tile << 18) |
+        ((uint32_t) occlusion << 26) | ((uint32_t) light << 28);
+}
+
+// position inside the chunk from a data word
+inline glm::vec3 unpackPosition(uint32_t data){
+    return glm::vec3(data & 31, (data >> 5) & 31, (data >> 10) & 31);
+}
+
+// chunk x and z the chunk word can hold, 12 bits biased by 2048
+const int CHUNK_COORD_MIN = -2048;
+const int CHUNK_COORD_MAX = 2047;
+
+// chunk coordinates, x and z within CHUNK_COORD_MIN to CHUNK_COORD_MAX, y within 0 - 255
+inline uint32_t packChunk(int x, int y, int z){
+    return (uint32_t) (x + 2048) | ((uint32_t) y << 12) | ((uint32_t) (z + 2048) << 20);
+}
+
+// range of one uploaded mesh in the shared vertex arena, filled by Render::uploadMesh
+struct Mesh {
+    GLint baseVertex = -1;      // first vertex in the arena, -1 when nothing is allocated
+    GLsizei rangeSize = 0;      // verticies reserved in the arena, see VertexArena::rangeSize
+    GLsizei indexCount = 0;     // indicies to draw from the shared quad index buffer
+
+    bool hasGeometry() const {
+        return indexCount > 0;
+    }
+};
+
+
+// occlusion query of a chunks bounding box, see Render::queryBox
+struct OcclusionQuery {
+    GLuint id = 0;
+    bool pending = false;       // issued, result not read yet
+    bool occluded = false;      // last result read, no samples of the box passed the depth test
+    int frame = 0;              // frame the query was issued
+};
+
+
+// mesher used by Chunk::createMesh
+enum Mesher {
+    FACE_MESHER,        // one quad per visible face, neighbour checks per block
+    BITMASK_MESHER,     // same quads, visible faces found a row of blocks at a time from bitmasks
+    GREEDY_MESHER       // merges coplanar faces of the same type
+};
+
+
+// which faces of a chunk see each other through see through voxels, faces as mesher
+// filled by a flood fill in Chunk::createMesh, walked by ChunkManager to skip chunks hidden in caves
+struct FaceConnectivity {
+    uint8_t faces[6] = {};      // bit b of faces[a] set when face a connects to face b
+
+    static FaceConnectivity all(){
+        FaceConnectivity connectivity;
+        for(int face = 0; face < 6; face++) connectivity.faces[face] = 0x3f;
+        return connectivity;
+    }
+
+    void connect(int a, int b){
+        faces[a] |= 1 << b;
+        faces[b] |= 1 << a;
+    }
+
+    bool isConnected(int a, int b) const {
+        return (faces[a] >> b) & 1;
+    }
+};
+
+
+// cpu side mesh data, uploaded then reused for the next mesh
+// 4 verticies per quad, indicies come from the shared quad index buffer in Render
+struct MeshData {
+    std::vector<Vertex> verticies;
+};
+
+
+// output of the chunk mesher
+// built off the render thread, uploaded from here, then returned to the ChunkManager pool
+// vectors keep their capacity between meshes so rebuilding allocates nothing once warm
+struct ChunkMeshData {
+    MeshData solid;
+    MeshData transparent;
+    int vertexCount = 0;
+    bool skipped = false;       // skipped using summary flags, no voxel scan
+    FaceConnectivity connectivity;
+    float buildTimeMs = 0.0f;
+};
+
+
+// collects quads of one mesh into scratch memory sized for the worst case chunk
+// every voxel showing all 6 faces, so quads are written with plain stores and no bounds checks
+// one per mesh type per thread, see Chunk::createMesh
+class MeshBuilder {
+public:
+    static const int MAX_QUADS = 16 * 16 * 16 * 6;
+
+private:
+    std::vector<Vertex> scratch;    // allocated once, MAX_QUADS * 4
+    Vertex * next;                  // where the next quad is written
+    uint32_t chunk = 0;             // chunk word of every vertex
+
+public:
+    MeshBuilder() : scratch(MAX_QUADS * 4) {
+        next = scratch.data();
+    }
+
+    // start a mesh for the chunk word from packChunk
+    void reset(uint32_t chunk){
+        next = scratch.data();
+        this->chunk = chunk;
+    }
+
+    int getVertexCount() const {
+        return next - scratch.data();
+    }
+
+    // data words of the 4 corners, see packVertex
+    void addQuad(uint32_t a, uint32_t b, uint32_t c, uint32_t d){
+        next[0] = {a, chunk};
+        next[1] = {b, chunk};
+        next[2] = {c, chunk};
+        next[3] = {d, chunk};
+        next += 4;
+    }
+
+    // copy quads into out, no allocation once out has grown
+    // copied, not moved: the scratch keeps its worst case size for the next mesh and out is a pooled
+    // ChunkMeshData (see ChunkManager::acquireMeshData) that keeps its capacity, so neither side reallocates
+    void finish(MeshData & out) const {
+        out.verticies.assign(scratch.begin(), scratch.begin() + getVertexCount());
+    }
+};
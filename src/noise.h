@@ -0,0 +1,161 @@
+#pragma once
+#include "header.h"
+#include <climits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define STB_PERLIN_IMPLEMENTATION
+#include "../lib/stb_perlin.h"
+
+/*
+Noise
+perlin noise for a whole grid of samples per call, same values as stb_perlin_noise3_seed without wrapping
+
+sample (i, k) of a sizeX by sizeZ grid is at ((originX + i) * frequency, y, (originZ + k) * frequency)
+and is written to out[k * sizeX + i]
+
+with SSE2 four samples along x run in the lanes of one pass: floors, fractions, fade curves,
+gradient dots and lerps. the y and z parts are worked out once per row (PerlinRow).
+the permutation table lookups stay scalar (no gather in SSE2), when the four samples share a lattice cell,
+as they do at terrain frequencies, they are looked up once and kept until the row moves to the next cell
+
+the lanes do the same float operations in the same order as stb, so results are bit identical.
+a build with fma enabled may fuse the two sides differently, they then differ by a few ulp (below 1e-6)
+*/
+
+// stb gradient basis split into components, indexed by stb__perlin_randtab_grad_idx
+static const float perlinGradX[12] = { 1, -1,  1, -1,  1, -1,  1, -1,  0,  0,  0,  0};
+static const float perlinGradY[12] = { 1,  1, -1, -1,  0,  0,  0,  0,  1, -1,  1, -1};
+static const float perlinGradZ[12] = { 0,  0,  0,  0,  1,  1, -1, -1,  1,  1, -1, -1};
+
+// gradient indicies of the 8 lattice corners of a cell, corner bits x << 2 | y << 1 | z
+static void perlinCorners(int px, int py, int pz, unsigned char seed, int grad[8]){
+    int x0 = px & 255, x1 = (px + 1) & 255;
+    int y0 = py & 255, y1 = (py + 1) & 255;
+    int z0 = pz & 255, z1 = (pz + 1) & 255;
+
+    int r0 = stb__perlin_randtab[x0 + seed];
+    int r1 = stb__perlin_randtab[x1 + seed];
+    int r[4] = {
+        stb__perlin_randtab[r0 + y0], stb__perlin_randtab[r0 + y1],
+        stb__perlin_randtab[r1 + y0], stb__perlin_randtab[r1 + y1]
+    };
+
+    for(int c = 0; c < 4; c++){
+        grad[c * 2] = stb__perlin_randtab_grad_idx[r[c] + z0];
+        grad[c * 2 + 1] = stb__perlin_randtab_grad_idx[r[c] + z1];
+    }
+}
+
+#ifdef __SSE2__
+// stb__perlin_fastfloor per lane, truncate then step down where that rounded up
+static inline __m128i perlinFloor(__m128 a){
+    __m128i truncated = _mm_cvttps_epi32(a);
+    __m128 above = _mm_cmplt_ps(a, _mm_cvtepi32_ps(truncated));
+    return _mm_add_epi32(truncated, _mm_castps_si128(above));
+}
+
+// stb__perlin_ease, ((t * 6 - 15) * t + 10) * t * t * t in the same order
+static inline __m128 perlinFade(__m128 t){
+    __m128 f = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f)), t), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, t), t), t);
+}
+
+static inline __m128 perlinLerp(__m128 a, __m128 b, __m128 t){
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// y and z of one grid row, the same for all lanes
+struct PerlinRow {
+    int cellY, cellZ;
+    __m128 v, w;
+    __m128 offsetY[2], offsetZ[2];
+
+    PerlinRow(float y, float z){
+        cellY = stb__perlin_fastfloor(y);
+        cellZ = stb__perlin_fastfloor(z);
+        __m128 fy = _mm_sub_ps(_mm_set1_ps(y), _mm_cvtepi32_ps(_mm_set1_epi32(cellY)));
+        __m128 fz = _mm_sub_ps(_mm_set1_ps(z), _mm_cvtepi32_ps(_mm_set1_epi32(cellZ)));
+        v = perlinFade(fy);
+        w = perlinFade(fz);
+        offsetY[0] = fy; offsetY[1] = _mm_sub_ps(fy, _mm_set1_ps(1.0f));
+        offsetZ[0] = fz; offsetZ[1] = _mm_sub_ps(fz, _mm_set1_ps(1.0f));
+    }
+};
+
+// gradient components of the 8 cell corners per lane
+struct PerlinGradients {
+    __m128 x[8], y[8], z[8];
+
+    void load(const int * cellX, bool shared, const PerlinRow & row, unsigned char seed){
+        int grad[4][8];
+        if(shared){
+            perlinCorners(cellX[0], row.cellY, row.cellZ, seed, grad[0]);
+            for(int c = 0; c < 8; c++){
+                x[c] = _mm_set1_ps(perlinGradX[grad[0][c]]);
+                y[c] = _mm_set1_ps(perlinGradY[grad[0][c]]);
+                z[c] = _mm_set1_ps(perlinGradZ[grad[0][c]]);
+            }
+            return;
+        }
+        for(int lane = 0; lane < 4; lane++) perlinCorners(cellX[lane], row.cellY, row.cellZ, seed, grad[lane]);
+        for(int c = 0; c < 8; c++){
+            x[c] = _mm_setr_ps(perlinGradX[grad[0][c]], perlinGradX[grad[1][c]], perlinGradX[grad[2][c]], perlinGradX[grad[3][c]]);
+            y[c] = _mm_setr_ps(perlinGradY[grad[0][c]], perlinGradY[grad[1][c]], perlinGradY[grad[2][c]], perlinGradY[grad[3][c]]);
+            z[c] = _mm_setr_ps(perlinGradZ[grad[0][c]], perlinGradZ[grad[1][c]], perlinGradZ[grad[2][c]], perlinGradZ[grad[3][c]]);
+        }
+    }
+};
+
+// noise at 4 points along x of a row
+static inline __m128 perlinNoise4(__m128 x, const PerlinRow & row, PerlinGradients & gradients, int & cachedCell, unsigned char seed){
+    __m128i px = perlinFloor(x);
+    __m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(px));
+    __m128 u = perlinFade(fx);
+
+    alignas(16) int cellX[4];
+    _mm_store_si128((__m128i *) cellX, px);
+    bool shared = cellX[0] == cellX[1] && cellX[0] == cellX[2] && cellX[0] == cellX[3];
+    if(!shared || cellX[0] != cachedCell){
+        gradients.load(cellX, shared, row, seed);
+        cachedCell = shared ? cellX[0] : INT_MIN;
+    }
+
+    __m128 offsetX[2] = {fx, _mm_sub_ps(fx, _mm_set1_ps(1.0f))};
+    __m128 n[8];
+    for(int c = 0; c < 8; c++){
+        n[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gradients.x[c], offsetX[c >> 2]), _mm_mul_ps(gradients.y[c], row.offsetY[(c >> 1) & 1])), _mm_mul_ps(gradients.z[c], row.offsetZ[c & 1]));
+    }
+
+    __m128 n00 = perlinLerp(n[0], n[1], row.w);
+    __m128 n01 = perlinLerp(n[2], n[3], row.w);
+    __m128 n10 = perlinLerp(n[4], n[5], row.w);
+    __m128 n11 = perlinLerp(n[6], n[7], row.w);
+    __m128 n0 = perlinLerp(n00, n01, row.v);
+    __m128 n1 = perlinLerp(n10, n11, row.v);
+    return perlinLerp(n0, n1, u);
+}
+#endif
+
+// perlin noise over a sizeX by sizeZ grid at height y, see above for layout
+static void perlinNoiseGrid(float originX, float y, float originZ, float frequency, int sizeX, int sizeZ, int seed, float * out){
+    for(int k = 0; k < sizeZ; k++){
+        float z = (originZ + k) * frequency;
+        float * row = out + k * sizeX;
+        int i = 0;
+#ifdef __SSE2__
+        PerlinRow lanes(y, z);
+        PerlinGradients gradients;
+        int cachedCell = INT_MIN;
+        for(; i + 4 <= sizeX; i += 4){
+            __m128 index = _mm_cvtepi32_ps(_mm_setr_epi32(i, i + 1, i + 2, i + 3));
+            __m128 x = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(originX), index), _mm_set1_ps(frequency));
+            _mm_storeu_ps(row + i, perlinNoise4(x, lanes, gradients, cachedCell, (unsigned char) seed));
+        }
+#endif
+        for(; i < sizeX; i++){
+            row[i] = stb_perlin_noise3_seed((originX + i) * frequency, y, z, 0, 0, 0, seed);
+        }
+    }
+}
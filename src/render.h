@@ -1,6 +1,9 @@
 #pragma once
 #include "header.h"
 #include "camera.h"
+#include "mesh.h"
+#include "atlas.h"
+#include "vertexArena.h"
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -10,34 +13,67 @@
 Render
 has all opengl rendering functions, manages loading shaders, images and rendering 
 instance of this class is created in main.cpp
+
+meshes are ranges of one shared vertex buffer (the arena), uploaded once with uploadMesh
+the buffer starts at ARENA_VERTICIES and doubles, copied on the gpu, when a mesh doesn't fit
+all meshes share one static quad index buffer, built at init for the largest possible chunk mesh
+
+drawing is queued: queueDraw collects the frames meshes, drawQueue sets state once per pass
+and draws each pass, opaque then transparent, with one glMultiDrawElementsBaseVertex
+
+occlusion queries draw chunk bounding boxes with box.vert/box.frag after the scene,
+results are read without stalling a frame or more later
 */
 
 
 class Render {
 private:
-	const int SHADER_INPUT_SIZE = 6;	// x, y, z, ux, uy, shadow	// number of floats per vertex passed as layout
 
     // file paths
     std::string vertexShaderPath = "src/shaders/shader.vert";
     std::string fragmentShaderPath = "src/shaders/shader.frag";
+    std::string boxVertexShaderPath = "src/shaders/box.vert";
+    std::string boxFragmentShaderPath = "src/shaders/box.frag";
 
 	std::string texturePath = "src/textures/blocks.png";
 
     GLuint shaderProgram;
-    GLuint VAO, VBO, EBO;
 	GLuint texture;
 
+	// occlusion query boxes, a unit cube scaled to chunk bounds
+	GLuint boxProgram;
+	GLuint boxVAO = 0;
+	GLuint boxVBO = 0;
+	GLuint boxEBO = 0;
+	GLint boxViewLoc = -1;
+	GLint boxMinLoc = -1;
+	GLint boxSizeLoc = -1;
+	GLuint quadIndexBuffer = 0;	// shared by every mesh, see createQuadIndexBuffer
+	GLint viewLoc = -1;
+
+	// shared vertex buffer for all meshes
+	const int ARENA_VERTICIES = 1 << 20;	// initial size, 8 MB
+	VertexArena arena = VertexArena(ARENA_VERTICIES);
+	GLuint arenaVAO = 0;
+	GLuint arenaVBO = 0;
+
+	// draws queued for this frame, per pass: 0 opaque, 1 transparent
+	std::vector<GLsizei> drawCounts[2];
+	std::vector<GLint> drawBaseVerticies[2];
+	std::vector<const GLvoid*> drawIndexOffsets;	// every draw starts at the first quad index
+
     glm::mat4 projectionMatrix;
 
     
-	void shaderInit(){
+	// compile and link a program from two shader files, 0 if they can't be read
+	GLuint loadProgram(const std::string & vertexPath, const std::string & fragmentPath){
 		// 1. load the shader files
 		std::string vertexShaderCode;
 		std::string fragmentShaderCode;
 
 		try {
-			std::ifstream vertexShaderStream(vertexShaderPath, std::ios::in);
-			std::ifstream fragmentShaderStream(fragmentShaderPath, std::ios::in);
+			std::ifstream vertexShaderStream(vertexPath, std::ios::in);
+			std::ifstream fragmentShaderStream(fragmentPath, std::ios::in);
 
 			if(!vertexShaderStream.is_open()) throw std::runtime_error("Cannot open vertex shader file");
 			if(!fragmentShaderStream.is_open()) throw std::runtime_error("Cannot open fragment shader file");
@@ -58,7 +94,7 @@ private:
 
 		if (vertexShaderCode.empty() || fragmentShaderCode.empty()) {
 			std::cerr << "Error: Shader code is empty." << std::endl;
-			return;
+			return 0;
 		}
 		
 
@@ -93,57 +129,148 @@ private:
 		}
 
 		// create shader program
-		shaderProgram = glCreateProgram();
-		glAttachShader(shaderProgram, vertex);
-		glAttachShader(shaderProgram, fragment);
-		glLinkProgram(shaderProgram);
-		glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);	// check sucess
+		GLuint program = glCreateProgram();
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &success);	// check sucess
 		if(!success){
 			char infoLog[512];
-			glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
 			std::cerr << "Error: Shader Program Linking Failed\n" << infoLog << std::endl;
 		}
 
 		// delete shaders - now linked to program, no longer needed
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
+		return program;
 	}
 
 
-	void createBuffers(){
+	void shaderInit(){
+		shaderProgram = loadProgram(vertexShaderPath, fragmentShaderPath);
+		boxProgram = loadProgram(boxVertexShaderPath, boxFragmentShaderPath);
+	}
 
-		// Create Vertex Array Object
-		glGenVertexArrays(1, &VAO);
-		glBindVertexArray(VAO);
 
-		// Create a Vertex Buffer Object and copy the vertex data to it
-		glGenBuffers(1, &VBO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_DYNAMIC_DRAW); // will be updated later
+	// element buffer with two triangles for each of the most quads a chunk mesh can have
+	void createQuadIndexBuffer(){
+		std::vector<unsigned int> indicies(MeshBuilder::MAX_QUADS * 6);
+		for(int quad = 0; quad < MeshBuilder::MAX_QUADS; quad++){
+			unsigned int base = quad * 4;
+			unsigned int * index = &indicies[quad * 6];
+			index[0] = base;
+			index[1] = base + 1;
+			index[2] = base + 2;
+			index[3] = base;
+			index[4] = base + 2;
+			index[5] = base + 3;
+		}
 
-		// create an Element Buffer Object
-		glGenBuffers(1, &EBO);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, NULL, GL_DYNAMIC_DRAW);	// will be updated later
+		glGenBuffers(1, &quadIndexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicies.size() * sizeof(unsigned int), indicies.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
 
 
+	// point the arena vao at the current arena buffer, vertex layout matches shader
+	void bindArenaAttributes(){
+		glBindVertexArray(arenaVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+
 		// define the vertex attribute pointer
-		// for positions - layer 0
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SHADER_INPUT_SIZE * sizeof(GLfloat), (GLvoid*)0);
+		// packed vertex - layer 0, 1 unsigned int read as an integer, decoded in shader
+		glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(Vertex), (GLvoid*)0);
 		glEnableVertexAttribArray(0);
-		// for colors - layer 1
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, SHADER_INPUT_SIZE * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+		// chunk coordinates - layer 1, 1 unsigned int
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Vertex), (GLvoid*)sizeof(uint32_t));
 		glEnableVertexAttribArray(1);
-		// for shadows - layer 2, 1 number
-		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, SHADER_INPUT_SIZE * sizeof(GLfloat), (GLvoid*)(5 * sizeof(GLfloat)));
-		glEnableVertexAttribArray(2);
 
 		// Unbind the VAO
 		glBindVertexArray(0);
+	}
 
-		glEnable(GL_DEPTH_TEST);
-		glDepthFunc(GL_LESS);
 
+	// create the shared vertex buffer and its vao
+	void createArena(){
+
+		// Create Vertex Array Object
+		glGenVertexArrays(1, &arenaVAO);
+		glBindVertexArray(arenaVAO);
+
+		// shared quad indicies, binding is stored in the vao
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
+		glBindVertexArray(0);
+
+		// Create a Vertex Buffer Object, ranges are filled in uploadMesh
+		glGenBuffers(1, &arenaVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) arena.getCapacity() * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+
+		bindArenaAttributes();
+	}
+
+
+	// unit cube for occlusion query boxes
+	void createBox(){
+		float corners[8][3] = {
+			{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+			{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
+		};
+		// faces are drawn without culling, so winding doesn't matter
+		unsigned int indicies[36] = {
+			0, 1, 2, 0, 2, 3,	// back
+			4, 5, 6, 4, 6, 7,	// front
+			3, 2, 6, 3, 6, 7,	// top
+			0, 1, 5, 0, 5, 4,	// bottom
+			1, 2, 6, 1, 6, 5,	// right
+			0, 3, 7, 0, 7, 4	// left
+		};
+
+		glGenVertexArrays(1, &boxVAO);
+		glBindVertexArray(boxVAO);
+
+		glGenBuffers(1, &boxVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+		glGenBuffers(1, &boxEBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indicies), indicies, GL_STATIC_DRAW);
+
+		// corner position - layer 0
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+
+		glBindVertexArray(0);
+
+		glUseProgram(boxProgram);
+		glUniformMatrix4fv(glGetUniformLocation(boxProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+		boxViewLoc = glGetUniformLocation(boxProgram, "view");
+		boxMinLoc = glGetUniformLocation(boxProgram, "boxMin");
+		boxSizeLoc = glGetUniformLocation(boxProgram, "boxSize");
+	}
+
+
+	// double the arena until size verticies fit at its end, existing ranges are copied on the gpu
+	void growArena(int size){
+		int oldCapacity = arena.getCapacity();
+		int newCapacity = oldCapacity * 2;
+		while(newCapacity - oldCapacity < size) newCapacity *= 2;
+
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) newCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, arenaVBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr) oldCapacity * sizeof(Vertex));
+
+		glDeleteBuffers(1, &arenaVBO);
+		arenaVBO = buffer;
+		arena.grow(newCapacity);
+		bindArenaAttributes();
 	}
 
 
@@ -184,87 +311,207 @@ public:
     Render(){}
 
 
-	bool init(int windowWidth, int windowHeight){
+	bool init(int windowWidth, int windowHeight, Atlas & atlas){
 		projectionMatrix = glm::perspective(glm::radians(90.0f), (float) windowWidth / (float) windowHeight, 0.1f, 1000.0f);
 		shaderInit();
-        createBuffers();
 		loadTexture();
+		createQuadIndexBuffer();
+		createArena();
+		createBox();
+
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
 
 		glUseProgram(shaderProgram);
 		// set projection matrix in shader
 		GLint projLoc = glGetUniformLocation(shaderProgram, "projection");
 		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+		viewLoc = glGetUniformLocation(shaderProgram, "view");
+
+		// number of tiles in atlas, used to wrap texture coordinates into a tile
+		GLint atlasLoc = glGetUniformLocation(shaderProgram, "atlasTiles");
+		glUniform2f(atlasLoc, 1.0f / atlas.UV_WIDTH, 1.0f / atlas.UV_HEIGHT);
 		return true;
 	}
 
 
-    // Render function, called to render the object 
-    // format{ x y z r g b,} for 3 points, per triangle
-    bool renderData(glm::mat4 viewMatrix, std::vector<float> verticies, std::vector<unsigned int> indicies, bool transparent = false){
-        if(verticies.empty() || indicies.empty()){
-           // std::cout << "Vertex Data is empty" << std::endl;
-            return false;
-        }
+	glm::mat4 getProjectionMatrix(){
+		return projectionMatrix;
+	}
+
+
+	// copy mesh data into the arena, called once each time the mesh is rebuilt
+	// reuses the meshes range when the new mesh fits, data is not kept so the caller can reuse it
+	void uploadMesh(Mesh & mesh, const MeshData & data){
+		// nothing to draw, no need for a range
+		if(data.verticies.empty()){
+			deleteMesh(mesh);
+			return;
+		}
 
-		// defined in shader
-		//glm::mat4 worldMatrix = glm::mat4(1.0f);	// Form World Matrix
+		int count = data.verticies.size();
+		int size = VertexArena::rangeSize(count);
 
-		if(transparent){
-			glDisable(GL_CULL_FACE);	
-			glEnable(GL_BLEND);       // Enable blending for transparent objects
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // Set blending function
+		if(mesh.baseVertex >= 0 && size <= mesh.rangeSize){
+			// fits the old range, hand back the unused tail
+			if(size < mesh.rangeSize) arena.free(mesh.baseVertex + size, mesh.rangeSize - size);
 		} else {
-			glDisable(GL_BLEND);      // Disable blending for opaque objects
-			glEnable(GL_CULL_FACE);   // Enable backface culling
-			glCullFace(GL_BACK);      // Cull back faces
-			glFrontFace(GL_CCW);      
+			deleteMesh(mesh);
+			mesh.baseVertex = arena.allocate(size);
+			if(mesh.baseVertex == VertexArena::INVALID){
+				growArena(size);
+				mesh.baseVertex = arena.allocate(size);
+			}
 		}
-		
 
+		glBindBuffer(GL_ARRAY_BUFFER, arenaVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) mesh.baseVertex * sizeof(Vertex), count * sizeof(Vertex), data.verticies.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		mesh.rangeSize = size;
+		// 6 indicies per 4 vertex quad
+		mesh.indexCount = count / 4 * 6;
+	}
+
+
+	// free the arena range of a mesh
+	void deleteMesh(Mesh & mesh){
+		if(mesh.baseVertex >= 0) arena.free(mesh.baseVertex, mesh.rangeSize);
+		mesh.baseVertex = -1;
+		mesh.rangeSize = 0;
+		mesh.indexCount = 0;
+	}
+
+
+	VertexArena::Stats getArenaStats() const {
+		return arena.getStats();
+	}
+
+
+	// add an uploaded mesh to this frames draws, drawn by drawQueue
+	void queueDraw(const Mesh & mesh, bool transparent = false){
+		if(mesh.indexCount == 0) return;
+
+		int pass = transparent ? 1 : 0;
+		drawCounts[pass].push_back(mesh.indexCount);
+		drawBaseVerticies[pass].push_back(mesh.baseVertex);
+	}
+
+
+	// draw everything queued this frame and clear the queue, returns draw calls issued
+	// each pass is one multi draw, state is set once per pass
+	int drawQueue(glm::mat4 viewMatrix){
 		// Use the shader program
 		glUseProgram(shaderProgram);
 
-
 		// bind texture
 		glBindTexture(GL_TEXTURE_2D, texture);
 
-
-		// Pass matrices to the shader
-		//GLint modelLoc = glGetUniformLocation(shaderProgram, "model");	// define in shader for performace
-		GLint viewLoc = glGetUniformLocation(shaderProgram, "view");
-		// GLint projLoc = glGetUniformLocation(shaderProgram, "projection");	// passed at start
+		// Pass view matrix to the shader, model is defined in shader and projection passed at init
 		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-		// glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
 
+		glBindVertexArray(arenaVAO);
 
-		// 5. Update Vertex Buffer Object (VBO) - new data
-		// use method: glBufferSubData not glMapBuffer
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, verticies.size() * sizeof(float), verticies.data(), GL_DYNAMIC_DRAW);
+		int drawCalls = 0;
+		for(int pass = 0; pass < 2; pass++){
+			if(drawCounts[pass].empty()) continue;
 
+			if(pass == 1){
+				glDisable(GL_CULL_FACE);
+				glEnable(GL_BLEND);       // Enable blending for transparent objects
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // Set blending function
+			} else {
+				glDisable(GL_BLEND);      // Disable blending for opaque objects
+				glEnable(GL_CULL_FACE);   // Enable backface culling
+				glCullFace(GL_BACK);      // Cull back faces
+				glFrontFace(GL_CCW);
+			}
 
-		// 6. Update Element Buffer Object (EBO) - new data
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicies.size() * sizeof(unsigned int), indicies.data(), GL_DYNAMIC_DRAW);
+			// indicies of every draw start at the first quad, base vertex moves them to the meshes range
+			if(drawIndexOffsets.size() < drawCounts[pass].size()) drawIndexOffsets.resize(drawCounts[pass].size(), nullptr);
 
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts[pass].data(), GL_UNSIGNED_INT,
+				drawIndexOffsets.data(), drawCounts[pass].size(), drawBaseVerticies[pass].data());
+			drawCalls++;
+
+			drawCounts[pass].clear();
+			drawBaseVerticies[pass].clear();
+		}
 
-		// 7. Render the object
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glDrawElements(GL_TRIANGLES, indicies.size(), GL_UNSIGNED_INT, nullptr);
 		glBindVertexArray(0);
+		return drawCalls;
+	}
+
+
+
+	// occlusion queries, drawn after the scene so boxes are tested against this frames depth
+	// nothing is written, a box with no passing samples is hidden behind what was drawn
+	void beginOcclusionQueries(glm::mat4 viewMatrix){
+		glUseProgram(boxProgram);
+		glUniformMatrix4fv(boxViewLoc, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+		glBindVertexArray(boxVAO);
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);		// box faces on the chunks own surface still pass
+		glDisable(GL_CULL_FACE);	// camera may be inside the box
+		glDisable(GL_BLEND);
+	}
+
+	// issue a query for a box, read it in a later frame with readQuery
+	void queryBox(OcclusionQuery & query, glm::vec3 min, glm::vec3 max, int frame){
+		if(query.id == 0) glGenQueries(1, &query.id);
+
+		glUniform3f(boxMinLoc, min.x, min.y, min.z);
+		glUniform3f(boxSizeLoc, max.x - min.x, max.y - min.y, max.z - min.z);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, query.id);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		query.pending = true;
+		query.frame = frame;
+	}
+
+	void endOcclusionQueries(){
+		glBindVertexArray(0);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
 
+	// take a finished query result without waiting on the gpu, false while still pending
+	bool readQuery(OcclusionQuery & query){
+		if(!query.pending) return false;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) return false;
+
+		GLuint samplesPassed = 0;
+		glGetQueryObjectuiv(query.id, GL_QUERY_RESULT, &samplesPassed);
+		query.occluded = samplesPassed == 0;
+		query.pending = false;
 		return true;
-		
+	}
+
+	void deleteQuery(OcclusionQuery & query){
+		if(query.id != 0) glDeleteQueries(1, &query.id);
+		query = OcclusionQuery();
 	}
 
 
 
 	// Destructor
 	void destroy(){
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &EBO);
+		glDeleteTextures(1, &texture);
+		glDeleteBuffers(1, &quadIndexBuffer);
+		glDeleteBuffers(1, &arenaVBO);
+		glDeleteVertexArrays(1, &arenaVAO);
+		glDeleteBuffers(1, &boxVBO);
+		glDeleteBuffers(1, &boxEBO);
+		glDeleteVertexArrays(1, &boxVAO);
+		glDeleteProgram(boxProgram);
 		glDeleteProgram(shaderProgram);
 
 		// Clean up and exit
@@ -0,0 +1,7 @@
+#version 330 core
+// colour writes are off while boxes are drawn, only the depth test matters
+out vec4 finalColor;
+
+void main() {
+    finalColor = vec4(1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+// unit cube scaled to a chunks bounds, for occlusion queries
+layout(location = 0) in vec3 corner;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+
+void main() {
+    gl_Position = projection * view * vec4(boxMin + corner * boxSize, 1.0);
+}
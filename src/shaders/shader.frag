@@ -1,12 +1,15 @@
 #version 330 core
 in vec2 texCord;
+flat in vec2 tileOffset;
 in float shadow;
 
 out vec4 finalColor;
 
 uniform sampler2D tex0;
+uniform vec2 atlasTiles;
 
 void main() {
-    vec4 textureColour = texture(tex0, texCord);
+    // wrap into the block tile so merged faces repeat the texture
+    vec4 textureColour = texture(tex0, tileOffset + fract(texCord) / atlasTiles);
     finalColor = textureColour * shadow;
 }
\ No newline at end of file
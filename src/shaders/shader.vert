@@ -1,17 +1,43 @@
 #version 330 core
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCordInput;
-layout(location = 2) in float shadowInput;
+// packed vertex, layout in mesh.h
+layout(location = 0) in uint vertexData;
+layout(location = 1) in uint chunkData;
 
 out vec2 texCord;
+flat out vec2 tileOffset;
 out float shadow;
 
 mat4 model = mat4(1.0); // define in vertex
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec2 atlasTiles;	// tiles across and down the atlas
+
+// brightness for block face - back, front, top, bottom, right, left
+const float brightness[6] = float[6](0.86, 0.86, 1.0, 1.0, 0.8, 0.8);
+
+// brightness for ambient occlusion level, 3 is unshaded
+const float occlusionBrightness[4] = float[4](0.5, 0.68, 0.84, 1.0);
+
+// each light level is 80% of the one above, dark places keep a little ambient light
+float lightBrightness(float level){
+    return 0.05 + 0.95 * pow(0.8, 15.0 - level);
+}
+
+// texture u and v in tiles follow these axes of the local position
+// repeats once per block, so merged faces tile the texture
+const vec3 uAxis[6] = vec3[6](vec3(1, 0, 0), vec3(1, 0, 0), vec3(1, 0, 0), vec3(1, 0, 0), vec3(0, 0, -1), vec3(0, 0, 1));
+const vec3 vAxis[6] = vec3[6](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, -1), vec3(0, 0, 1), vec3(0, -1, 0), vec3(0, -1, 0));
 
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
-    texCord = texCordInput;
-    shadow = shadowInput;
+    vec3 local = vec3(vertexData & 31u, (vertexData >> 5u) & 31u, (vertexData >> 10u) & 31u);
+    int face = int((vertexData >> 15u) & 7u);
+    float tile = float((vertexData >> 18u) & 255u);
+    int occlusion = int((vertexData >> 26u) & 3u);
+    float light = float(vertexData >> 28u);
+    vec3 chunk = vec3(float(chunkData & 4095u) - 2048.0, float((chunkData >> 12u) & 255u), float(chunkData >> 20u) - 2048.0);
+
+    gl_Position = projection * view * model * vec4(chunk * 16.0 + local, 1.0);
+    texCord = vec2(dot(local, uAxis[face]), dot(local, vAxis[face]));
+    tileOffset = vec2(mod(tile, atlasTiles.x), floor(tile / atlasTiles.x)) / atlasTiles;
+    shadow = brightness[face] * occlusionBrightness[occlusion] * lightBrightness(light);
 }
@@ -2,9 +2,7 @@
 #include "header.h"
 #include "chunk.h"
 #include "atlas.h"
-
-#define STB_PERLIN_IMPLEMENTATION
-#include "../lib/stb_perlin.h"
+#include "noise.h"
 
 
 
@@ -50,6 +48,10 @@ public:
 
     }
 
+    Atlas * getAtlas(){
+        return atlas;
+    }
+
     // generate stone with gass ontop
     Chunk generateChunk(glm::vec3 position){
         // top layer
@@ -57,12 +59,14 @@ public:
             // dirt with grass ontop
             Chunk chunk = Chunk(position, atlas, 0);
 
+            // heights of all 16x16 columns in one call, heights[z * 16 + x]
+            float heights[16 * 16];
+            perlinNoiseGrid(position.x * 16, position.y, position.z * 16, frequency, 16, 16, seed, heights);
+
             // grass
             for(int x = 0; x < 16; x++){
                 for(int z = 0; z < 16; z++){
-                    float nx = (x + position.x * 16) * frequency;
-                    float nz = (z + position.z * 16) * frequency;
-                    float height = stb_perlin_noise3_seed(nx, position.y, nz, 0, 0, 0, seed);
+                    float height = heights[z * 16 + x];
 
                     // Normalize height to a suitable range
                     int blockHeight = static_cast<int>((height + 1.0f) * amplitude); // Adjust scaling as needed
@@ -77,15 +81,18 @@ public:
                 }
             }
 
+            chunk.updateSummary();
             return chunk;
 
         } else if(position.y < 3) {
             // stone chunk
             Chunk chunk = Chunk(position, atlas, 3);
+            chunk.updateSummary();
             return chunk;
         } else {
             // air chunk
             Chunk chunk = Chunk(position, atlas, 0);
+            chunk.updateSummary();
             return chunk;
         }
     }
@@ -0,0 +1,191 @@
+#pragma once
+#include "header.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+Thread Pool
+fixed set of worker threads for chunk generation and meshing
+
+each worker owns a job queue, jobs are handed out round robin
+a worker takes from the back of its own queue and steals from the front of others when empty
+idle workers sleep until a job is submitted
+shutdown finishes the queued jobs before the workers stop
+
+jobs must not touch opengl, results go back to the main thread through a CompletionQueue
+*/
+
+typedef std::function<void()> Job;
+
+
+// multi producer, single consumer lock free queue (Vyukov)
+// workers push finished results, the main thread pops them each frame
+template <typename T>
+class CompletionQueue {
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+        Node() : next(nullptr) {}
+    };
+
+    std::atomic<Node*> head;    // last pushed node, producers swap in here
+    Node * tail;                // stub node before next value, consumer only
+
+public:
+    CompletionQueue(){
+        Node * stub = new Node();
+        head.store(stub);
+        tail = stub;
+    }
+
+    ~CompletionQueue(){
+        while(tail != nullptr){
+            Node * next = tail->next.load();
+            delete tail;
+            tail = next;
+        }
+    }
+
+    CompletionQueue(const CompletionQueue &) = delete;
+    CompletionQueue & operator=(const CompletionQueue &) = delete;
+
+    // safe from any thread
+    void push(T value){
+        Node * node = new Node();
+        node->value = std::move(value);
+        Node * prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // consumer thread only, false if nothing is ready
+    bool pop(T & out){
+        Node * next = tail->next.load(std::memory_order_acquire);
+        if(next == nullptr) return false;
+
+        out = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+};
+
+
+class ThreadPool {
+private:
+    // per worker queue, locked separately so stealing only contends with one worker
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<WorkQueue*> queues;
+    std::atomic<int> queuedJobs;
+    std::atomic<bool> running;
+    unsigned int nextQueue = 0;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    // newest job from own queue
+    bool popLocal(int index, Job & job){
+        WorkQueue * queue = queues[index];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if(queue->jobs.empty()) return false;
+        job = std::move(queue->jobs.back());
+        queue->jobs.pop_back();
+        return true;
+    }
+
+    // oldest job from another workers queue
+    bool steal(int index, Job & job){
+        for(size_t i = 1; i < queues.size(); i++){
+            WorkQueue * queue = queues[(index + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if(queue->jobs.empty()) continue;
+            job = std::move(queue->jobs.front());
+            queue->jobs.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    // after shutdown a worker keeps taking jobs until every queue is empty
+    void workerLoop(int index){
+        while(true){
+            Job job;
+            if(popLocal(index, job) || steal(index, job)){
+                queuedJobs--;
+                job();
+                continue;
+            }
+            if(!running) return;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]{ return !running || queuedJobs > 0; });
+        }
+    }
+
+public:
+    // defaults to one thread per core, leaving one for the render thread
+    ThreadPool(int threadCount = 0) : queuedJobs(0), running(true) {
+        if(threadCount <= 0) threadCount = std::max(1, (int) std::thread::hardware_concurrency() - 1);
+
+        for(int i = 0; i < threadCount; i++) queues.push_back(new WorkQueue());
+        for(int i = 0; i < threadCount; i++) workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool(){
+        shutdown();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    // called from the main thread
+    void submit(Job job){
+        WorkQueue * queue = queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->jobs.push_back(std::move(job));
+        }
+
+        // count under the sleep lock so a worker can't miss the wake up
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs++;
+        }
+        wake.notify_one();
+    }
+
+    int getThreadCount(){
+        return workers.size();
+    }
+
+    // jobs waiting to start
+    int getQueuedJobs(){
+        return queuedJobs;
+    }
+
+    // stop workers once the queued jobs have run, so every submitted job delivers its result
+    // jobs hold buffers handed to them by the main thread, dropping them would leak those
+    void shutdown(){
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if(!running) return;
+            running = false;
+        }
+        wake.notify_all();
+
+        for(std::thread & worker : workers) worker.join();
+        workers.clear();
+
+        for(WorkQueue * queue : queues) delete queue;
+        queues.clear();
+    }
+};
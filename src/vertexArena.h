@@ -0,0 +1,115 @@
+#pragma once
+#include "header.h"
+#include <map>
+
+/*
+Vertex Arena
+offset allocator for ranges of one large vertex buffer shared by every chunk mesh
+only hands out offsets, Render owns the gpu buffer and grows it when the arena is full
+
+free ranges are kept sorted by offset, allocation takes the first range big enough
+a freed range merges with free neighbours so streaming chunks in and out doesn't splinter the buffer
+range sizes are rounded up to GRANULARITY, so a remeshed chunk usually fits its old range
+and the free list doesn't fill with slivers too small for any mesh
+offsets and sizes are in verticies
+*/
+
+class VertexArena {
+public:
+    static const int INVALID = -1;
+    static const int GRANULARITY = 64;     // 16 quads
+
+    struct Stats {
+        int capacity = 0;
+        int used = 0;               // verticies in allocated ranges, including rounding
+        int freeRanges = 0;
+        int largestFree = 0;
+        float utilisation = 0.0f;   // used / capacity
+        float fragmentation = 0.0f; // share of free space outside the largest free range
+    };
+
+private:
+    int capacity;
+    int used = 0;
+    std::map<int, int> freeRanges;      // offset -> size
+
+public:
+    VertexArena(int capacity) : capacity(capacity) {
+        freeRanges[0] = capacity;
+    }
+
+    // size of the range allocated for a mesh of count verticies
+    static int rangeSize(int count){
+        return (count + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+    }
+
+    int getCapacity() const {
+        return capacity;
+    }
+
+    // offset of a new range, size from rangeSize, INVALID if no free range is big enough
+    int allocate(int size){
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it){
+            if(it->second < size) continue;
+
+            int offset = it->first;
+            int remaining = it->second - size;
+            freeRanges.erase(it);
+            if(remaining > 0) freeRanges[offset + size] = remaining;
+            used += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    // return a range, or the tail of one, from allocate
+    void free(int offset, int size){
+        used -= size;
+        auto next = freeRanges.lower_bound(offset);
+
+        // join the free range right after
+        if(next != freeRanges.end() && offset + size == next->first){
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+
+        // join the free range right before
+        if(next != freeRanges.begin()){
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset){
+                prev->second += size;
+                return;
+            }
+        }
+
+        freeRanges[offset] = size;
+    }
+
+    // add space at the end, the gpu buffer must already hold newCapacity verticies
+    void grow(int newCapacity){
+        int added = newCapacity - capacity;
+        int offset = capacity;
+        capacity = newCapacity;
+
+        // free() counts the range as released, it was never used
+        used += added;
+        free(offset, added);
+    }
+
+    // walks the free list, call once per frame at most
+    Stats getStats() const {
+        Stats stats;
+        stats.capacity = capacity;
+        stats.used = used;
+        stats.freeRanges = freeRanges.size();
+
+        int totalFree = 0;
+        for(auto & range : freeRanges){
+            totalFree += range.second;
+            stats.largestFree = std::max(stats.largestFree, range.second);
+        }
+        stats.utilisation = capacity > 0 ? (float) used / capacity : 0.0f;
+        stats.fragmentation = totalFree > 0 ? 1.0f - (float) stats.largestFree / totalFree : 0.0f;
+        return stats;
+    }
+};